@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+
+
+
+
+// Size of a cache line on the machines we care about.
+static const size_t CacheLineSize = 64;
+
+
+// Plain new doesn't promise more than max_align_t alignment before C++17, so
+// these align by hand and keep the real block address just in front of the
+// block they return.  alignment must be a power of two.
+inline void *AlignedAllocate(size_t size, size_t alignment = CacheLineSize)
+{
+	void *raw = ::operator new(size + alignment + sizeof(void *));
+	uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + sizeof(void *) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	reinterpret_cast<void **>(aligned)[-1] = raw;
+
+	return reinterpret_cast<void *>(aligned);
+}
+
+inline void AlignedFree(void *block)
+{
+	if (block != NULL)
+		::operator delete(reinterpret_cast<void **>(block)[-1]);
+}
+
+
+// Hints the CPU to start loading the line holding address.  Never faults, so
+// it is fine to point it past the end of an array.
+inline void Prefetch(const void *address)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(address);
+#else
+	(void)address;
+#endif
+}
@@ -0,0 +1,482 @@
+#pragma once
+
+#include <stdlib.h>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "AlignedMemory.h"
+
+
+
+
+// One node of a BTree.  Holds up to Fanout - 1 sorted keys and, unless it is
+// a leaf, Fanout children.  The keys sit in raw storage so that only the
+// slots in use hold a live item; empty slots cost no constructor calls.
+template <typename type, int Fanout>
+struct BTreeNode
+{
+public:
+	static const int MaxKeys = Fanout - 1;
+
+	int KeyCount;
+	bool IsLeaf;
+	typename std::aligned_storage<sizeof(type) * MaxKeys, std::alignment_of<type>::value>::type KeyStorage;
+	BTreeNode *Children[Fanout];
+
+	BTreeNode(bool isLeaf) :
+		KeyCount(0),
+		IsLeaf(isLeaf)
+	{}
+
+	type *Keys()
+	{
+		return reinterpret_cast<type *>(&KeyStorage);
+	}
+
+	const type *Keys() const
+	{
+		return reinterpret_cast<const type *>(&KeyStorage);
+	}
+};
+
+
+// A B-tree with the same Add/Remove/Contains/Count/Clear contract as
+// BinaryTree.  Each node packs many keys next to each other, so a lookup
+// touches about log2(Fanout) times fewer nodes (and cache misses) than it
+// would in a binary tree.  Fanout is the maximum number of children per node
+// and must be even; every node but the root stays at least half full.
+//
+// TreeHelper::ToVectorInOrder accepts GetRoot() just like it does for a
+// BinaryTree.
+template <typename type, int Fanout = 16>
+class BTree
+{
+	static_assert(Fanout >= 4 && Fanout % 2 == 0, "BTree Fanout must be an even number of at least 4.");
+
+private:
+	typedef BTreeNode<type, Fanout> Node;
+
+	// Minimum number of children of a non-root node (the "degree").
+	static const int MinChildren = Fanout / 2;
+	static const int MinKeys = MinChildren - 1;
+	static const int MaxKeys = Node::MaxKeys;
+
+	Node *_root;
+	int _count;
+
+	BTree(const BTree &);
+	BTree &operator=(const BTree &);
+
+
+	// Nodes start on a cache line so a node's header and first keys share one.
+	static Node *NewNode(bool isLeaf)
+	{
+		return new (AlignedAllocate(sizeof(Node))) Node(isLeaf);
+	}
+
+	// Frees a node whose keys have already been destroyed or moved out.
+	static void FreeNode(Node *node)
+	{
+		node->~Node();
+		AlignedFree(node);
+	}
+
+
+	// Moves the item in from into the empty slot to; from is left empty.
+	static void MoveKey(type *from, type *to)
+	{
+		new (to) type(std::move(*from));
+		from->~type();
+	}
+
+	// Opens an empty slot at index by moving the keys after it up one.
+	static void OpenKeySlot(Node *node, int index)
+	{
+		type *keys = node->Keys();
+		for (int i = node->KeyCount; i > index; i--)
+			MoveKey(&keys[i - 1], &keys[i]);
+	}
+
+	// Closes the empty slot at index by moving the keys after it down one.
+	static void CloseKeySlot(Node *node, int index)
+	{
+		type *keys = node->Keys();
+		for (int i = index; i < node->KeyCount - 1; i++)
+			MoveKey(&keys[i + 1], &keys[i]);
+	}
+
+	static void OpenChildSlot(Node *node, int index)
+	{
+		for (int i = node->KeyCount + 1; i > index; i--)
+			node->Children[i] = node->Children[i - 1];
+	}
+
+	static void CloseChildSlot(Node *node, int index)
+	{
+		for (int i = index; i < node->KeyCount; i++)
+			node->Children[i] = node->Children[i + 1];
+	}
+
+
+	// Index of the first key in node that is not less than value.
+	static int KeyIndex(const Node *node, const type &value)
+	{
+		const type *keys = node->Keys();
+		return (int)(std::lower_bound(keys, keys + node->KeyCount, value) - keys);
+	}
+
+	static bool KeyMatches(const Node *node, int index, const type &value)
+	{
+		return index < node->KeyCount && !(value < node->Keys()[index]);
+	}
+
+
+	// Splits the full child at index in two and moves its middle key up into
+	// parent, which must not be full.
+	static void SplitChild(Node *parent, int index)
+	{
+		Node *left = parent->Children[index];
+		Node *right = NewNode(left->IsLeaf);
+		type *leftKeys = left->Keys();
+		type *rightKeys = right->Keys();
+
+		for (int i = 0; i < MinKeys; i++)
+			MoveKey(&leftKeys[MinChildren + i], &rightKeys[i]);
+		if (!left->IsLeaf)
+			for (int i = 0; i < MinChildren; i++)
+				right->Children[i] = left->Children[MinChildren + i];
+
+		right->KeyCount = MinKeys;
+		left->KeyCount = MinKeys;
+
+		OpenKeySlot(parent, index);
+		OpenChildSlot(parent, index + 1);
+		MoveKey(&leftKeys[MinKeys], &parent->Keys()[index]);
+		parent->Children[index + 1] = right;
+		parent->KeyCount++;
+	}
+
+
+	// Folds the key at index and the child to its right into the child to its
+	// left, then frees the right child.
+	static void MergeChildren(Node *parent, int index)
+	{
+		Node *left = parent->Children[index];
+		Node *right = parent->Children[index + 1];
+		type *leftKeys = left->Keys();
+		type *rightKeys = right->Keys();
+
+		MoveKey(&parent->Keys()[index], &leftKeys[left->KeyCount]);
+		for (int i = 0; i < right->KeyCount; i++)
+			MoveKey(&rightKeys[i], &leftKeys[left->KeyCount + 1 + i]);
+		if (!left->IsLeaf)
+			for (int i = 0; i <= right->KeyCount; i++)
+				left->Children[left->KeyCount + 1 + i] = right->Children[i];
+
+		left->KeyCount += right->KeyCount + 1;
+
+		CloseKeySlot(parent, index);
+		CloseChildSlot(parent, index + 1);
+		parent->KeyCount--;
+
+		FreeNode(right);
+	}
+
+
+	// Makes sure the child at index has more than the minimum number of keys
+	// before Remove descends into it, by borrowing from a sibling or merging
+	// with one.  Returns the index of the child to descend into, which moves
+	// one to the left if it was merged into its left sibling.
+	static int FillChild(Node *parent, int index)
+	{
+		Node *child = parent->Children[index];
+		type *parentKeys = parent->Keys();
+
+		if (child->KeyCount > MinKeys)
+			return index;
+
+		if (index > 0 && parent->Children[index - 1]->KeyCount > MinKeys)
+		{
+			// Rotate a key from the left sibling through the parent.
+			Node *left = parent->Children[index - 1];
+
+			OpenKeySlot(child, 0);
+			MoveKey(&parentKeys[index - 1], &child->Keys()[0]);
+			MoveKey(&left->Keys()[left->KeyCount - 1], &parentKeys[index - 1]);
+
+			if (!child->IsLeaf)
+			{
+				OpenChildSlot(child, 0);
+				child->Children[0] = left->Children[left->KeyCount];
+			}
+
+			child->KeyCount++;
+			left->KeyCount--;
+			return index;
+		}
+
+		if (index < parent->KeyCount && parent->Children[index + 1]->KeyCount > MinKeys)
+		{
+			// Rotate a key from the right sibling through the parent.
+			Node *right = parent->Children[index + 1];
+
+			MoveKey(&parentKeys[index], &child->Keys()[child->KeyCount]);
+			MoveKey(&right->Keys()[0], &parentKeys[index]);
+			CloseKeySlot(right, 0);
+
+			if (!child->IsLeaf)
+			{
+				child->Children[child->KeyCount + 1] = right->Children[0];
+				CloseChildSlot(right, 0);
+			}
+
+			child->KeyCount++;
+			right->KeyCount--;
+			return index;
+		}
+
+		if (index < parent->KeyCount)
+		{
+			MergeChildren(parent, index);
+			return index;
+		}
+
+		MergeChildren(parent, index - 1);
+		return index - 1;
+	}
+
+
+	// Moves the largest (or smallest) key out of the subtree rooted at node
+	// into the empty slot target.  node must have more than the minimum
+	// number of keys.
+	static void TakeMax(Node *node, type *target)
+	{
+		while (!node->IsLeaf)
+			node = node->Children[FillChild(node, node->KeyCount)];
+
+		MoveKey(&node->Keys()[node->KeyCount - 1], target);
+		node->KeyCount--;
+	}
+
+	static void TakeMin(Node *node, type *target)
+	{
+		while (!node->IsLeaf)
+			node = node->Children[FillChild(node, 0)];
+
+		MoveKey(&node->Keys()[0], target);
+		CloseKeySlot(node, 0);
+		node->KeyCount--;
+	}
+
+
+	static void DestroySubtree(Node *node)
+	{
+		if (!node->IsLeaf)
+			for (int i = 0; i <= node->KeyCount; i++)
+				DestroySubtree(node->Children[i]);
+
+		type *keys = node->Keys();
+		for (int i = 0; i < node->KeyCount; i++)
+			keys[i].~type();
+
+		FreeNode(node);
+	}
+
+
+	template <typename Item>
+	void Insert(Item &&newItem)
+	{
+		if (_root == NULL)
+			_root = NewNode(true);
+
+		if (_root->KeyCount == MaxKeys)
+		{
+			Node *newRoot = NewNode(false);
+			newRoot->Children[0] = _root;
+			_root = newRoot;
+			SplitChild(newRoot, 0);
+		}
+
+		// Split any full node on the way down so there is always room to
+		// take the key that a split below pushes up.
+		Node *node = _root;
+		while (true)
+		{
+			int index = KeyIndex(node, newItem);
+			if (KeyMatches(node, index, newItem))
+				throw std::invalid_argument("BTree::Add: the item is already in the tree.");
+
+			if (node->IsLeaf)
+			{
+				// Count the open slot first: CloseKeySlot expects it counted.
+				OpenKeySlot(node, index);
+				node->KeyCount++;
+				try
+				{
+					new (&node->Keys()[index]) type(std::forward<Item>(newItem));
+				}
+				catch (...)
+				{
+					CloseKeySlot(node, index);
+					node->KeyCount--;
+					throw;
+				}
+
+				_count++;
+				return;
+			}
+
+			if (node->Children[index]->KeyCount == MaxKeys)
+			{
+				SplitChild(node, index);
+				if (!(newItem < node->Keys()[index]))
+				{
+					if (!(node->Keys()[index] < newItem))
+						throw std::invalid_argument("BTree::Add: the item is already in the tree.");
+					index++;
+				}
+			}
+
+			node = node->Children[index];
+		}
+	}
+
+public:
+	BTree() :
+		_root(NULL),
+		_count(0)
+	{}
+
+	~BTree()
+	{
+		Clear();
+	}
+
+
+	// Returns the root node, for TreeHelper.
+	const BTreeNode<type, Fanout> *GetRoot() const
+	{
+		return _root;
+	}
+
+
+	// Adds a new item to the tree.  Throws if the item is already there.
+	void Add(const type &newItem)
+	{
+		Insert(newItem);
+	}
+
+	void Add(type &&newItem)
+	{
+		Insert(std::move(newItem));
+	}
+
+
+	// Removes an item from the tree.  Throws if the item is not there.  Works
+	// top-down in a single pass: before stepping into a child that is at the
+	// minimum size, it borrows a key from a sibling or merges with one, so
+	// the removal itself never has to go back up.
+	void Remove(const type &value)
+	{
+		Node *node = _root;
+		bool removed = false;
+
+		while (node != NULL)
+		{
+			int index = KeyIndex(node, value);
+
+			if (KeyMatches(node, index, value))
+			{
+				type *keys = node->Keys();
+
+				if (node->IsLeaf)
+				{
+					keys[index].~type();
+					CloseKeySlot(node, index);
+					node->KeyCount--;
+					removed = true;
+					break;
+				}
+
+				if (node->Children[index]->KeyCount > MinKeys)
+				{
+					keys[index].~type();
+					TakeMax(node->Children[index], &keys[index]);
+					removed = true;
+					break;
+				}
+
+				if (node->Children[index + 1]->KeyCount > MinKeys)
+				{
+					keys[index].~type();
+					TakeMin(node->Children[index + 1], &keys[index]);
+					removed = true;
+					break;
+				}
+
+				// Both neighbors are at the minimum: pull the key down into
+				// the merged child and carry on removing it from there.
+				MergeChildren(node, index);
+				node = node->Children[index];
+				continue;
+			}
+
+			if (node->IsLeaf)
+				break;
+
+			node = node->Children[FillChild(node, index)];
+		}
+
+		// A merge can empty the root; the tree then gets one level shorter.
+		if (_root != NULL && _root->KeyCount == 0)
+		{
+			Node *oldRoot = _root;
+			_root = _root->IsLeaf ? NULL : _root->Children[0];
+			FreeNode(oldRoot);
+		}
+
+		if (!removed)
+			throw std::out_of_range("BTree::Remove: the item is not in the tree.");
+
+		_count--;
+	}
+
+
+	// Returns the number of items in the tree.
+	int Count()
+	{
+		return _count;
+	}
+
+
+	// Returns true if the item is in the tree.
+	bool Contains(const type &value)
+	{
+		const Node *node = _root;
+
+		while (node != NULL)
+		{
+			int index = KeyIndex(node, value);
+			if (KeyMatches(node, index, value))
+				return true;
+
+			node = node->IsLeaf ? NULL : node->Children[index];
+		}
+
+		return false;
+	}
+
+
+	// Deletes every item and node in the tree.
+	void Clear()
+	{
+		if (_root != NULL)
+			DestroySubtree(_root);
+
+		_root = NULL;
+		_count = 0;
+	}
+};
@@ -0,0 +1,413 @@
+// Micro-benchmarks for BinaryTree and TreeHelper.  This is its own program,
+// separate from the tests in main.cpp; build it with optimizations on, e.g.
+//
+//     c++ -std=gnu++11 -O2 -pthread Benchmark.cpp -o Benchmark
+//
+// and run it with any of:
+//
+//     --sizes=1000,1000000     tree sizes to try (default 1K to 1M; 100M
+//                              works but wants around 10 GB of memory)
+//     --distributions=random,zipfian
+//                              key orders to try: sorted, reverse, random
+//                              and zipfian (default all four)
+//     --trees=avl,pool         tree kinds to try: plain (NoBalance), avl,
+//                              pool (AvlBalance with PoolNodeAllocator),
+//                              splay (SplayBalance) and cached (AvlBalance
+//                              with LookupCache)
+//
+// Every measurement is printed as one JSON object per line, so the output can
+// be kept and compared between builds:
+//
+//     {"benchmark":"contains","tree":"avl","distribution":"zipfian",
+//      "size":1000000,"ops":1000000,"ns_per_op":182.4,
+//      "ops_per_sec":5482456.1,"peak_rss_kb":61212}
+//
+// The distribution decides the order keys are added, looked up and removed
+// in.  Zipfian lookups hit a few keys most of the time (the exponent is
+// 0.99, as in YCSB); its adds and removes are in random order, since a tree
+// can only hold each key once.  peak_rss_kb is the high-water mark of the
+// whole process so far, so it only ever goes up during a run.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#	define	WIN32_LEAN_AND_MEAN
+#	include <Windows.h>
+#	include <Psapi.h>
+#else
+#	include <sys/resource.h>
+#endif
+
+#include "BinaryTree.h"
+#include "TreeHelper.h"
+
+using namespace std;
+
+
+
+
+// Sorted or reverse-sorted adds into a plain tree make a list, and each
+// add walks all of it; past this size that takes too long to be useful.
+const size_t MaxDegenerateSize = 20000;
+
+// Deeper than this, the recursive traversals risk overflowing the stack and
+// are skipped.  A splay tree built from sorted keys is a list, for example.
+const int MaxRecursionDepth = 10000;
+
+// Written to at the end of every run, so the compiler can't skip the work.
+volatile long long Sink;
+
+
+
+
+long PeakRssKb()
+{
+#ifdef _MSC_VER
+	PROCESS_MEMORY_COUNTERS counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return (long)(counters.PeakWorkingSetSize / 1024);
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#	ifdef __APPLE__
+	return (long)(usage.ru_maxrss / 1024);
+#	else
+	return (long)usage.ru_maxrss;
+#	endif
+#endif
+}
+
+
+void Report(const char *benchmark, const string &tree, const string &distribution, size_t size, size_t ops, double seconds)
+{
+	double nsPerOp = ops == 0 ? 0 : seconds * 1e9 / ops;
+	double opsPerSec = seconds <= 0 ? 0 : ops / seconds;
+
+	printf("{\"benchmark\":\"%s\",\"tree\":\"%s\",\"distribution\":\"%s\",\"size\":%lu,\"ops\":%lu,\"ns_per_op\":%.1f,\"ops_per_sec\":%.1f,\"peak_rss_kb\":%ld}\n",
+		benchmark, tree.c_str(), distribution.c_str(), (unsigned long)size, (unsigned long)ops, nsPerOp, opsPerSec, PeakRssKb());
+	fflush(stdout);
+}
+
+
+class Stopwatch
+{
+private:
+	chrono::steady_clock::time_point _start;
+
+public:
+	Stopwatch() :
+		_start(chrono::steady_clock::now())
+	{}
+
+	double Seconds() const
+	{
+		return chrono::duration<double>(chrono::steady_clock::now() - _start).count();
+	}
+};
+
+
+// Draws ranks 0..n-1 with probability proportional to 1 / (rank + 1)^theta,
+// using the method from Gray et al., "Quickly Generating Billion-Record
+// Synthetic Databases".  Setting up is O(n); each draw is O(1).
+class ZipfianGenerator
+{
+private:
+	size_t _n;
+	double _theta;
+	double _alpha;
+	double _zetan;
+	double _eta;
+	uniform_real_distribution<double> _uniform;
+
+	static double Zeta(size_t n, double theta)
+	{
+		double sum = 0;
+		for (size_t i = 1; i <= n; i++)
+			sum += 1 / pow((double)i, theta);
+
+		return sum;
+	}
+
+public:
+	ZipfianGenerator(size_t n, double theta) :
+		_n(n),
+		_theta(theta),
+		_alpha(1 / (1 - theta)),
+		_zetan(Zeta(n, theta)),
+		_uniform(0, 1)
+	{
+		_eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - Zeta(2, theta) / _zetan);
+	}
+
+	template <typename Random>
+	size_t operator()(Random &random)
+	{
+		double u = _uniform(random);
+		double uz = u * _zetan;
+
+		if (uz < 1)
+			return 0;
+		if (uz < 1 + pow(0.5, _theta))
+			return 1;
+
+		size_t rank = (size_t)(_n * pow(_eta * u - _eta + 1, _alpha));
+		return rank < _n ? rank : _n - 1;
+	}
+};
+
+
+// The keys in the order one distribution adds them, and the order it looks
+// them up and removes them.
+struct Workload
+{
+	vector<int> AddOrder;
+	vector<int> LookupOrder;
+	vector<int> RemoveOrder;
+};
+
+
+Workload MakeWorkload(const string &distribution, size_t size)
+{
+	Workload workload;
+	mt19937_64 random(size);
+
+	vector<int> sorted(size);
+	for (size_t i = 0; i < size; i++)
+		sorted[i] = (int)i;
+
+	vector<int> shuffled = sorted;
+	shuffle(shuffled.begin(), shuffled.end(), random);
+
+	if (distribution == "sorted")
+	{
+		workload.AddOrder = sorted;
+		workload.LookupOrder = sorted;
+		workload.RemoveOrder = sorted;
+	}
+	else if (distribution == "reverse")
+	{
+		workload.AddOrder.assign(sorted.rbegin(), sorted.rend());
+		workload.LookupOrder = workload.AddOrder;
+		workload.RemoveOrder = workload.AddOrder;
+	}
+	else
+	{
+		workload.AddOrder = shuffled;
+		shuffle(shuffled.begin(), shuffled.end(), random);
+		workload.RemoveOrder = shuffled;
+
+		if (distribution == "zipfian")
+		{
+			// Rank 0 is the hottest key; the keys are spread over the tree
+			// by the random order so the hot ones aren't all neighbours.
+			ZipfianGenerator zipfian(size, 0.99);
+			workload.LookupOrder.resize(size);
+			for (size_t i = 0; i < size; i++)
+				workload.LookupOrder[i] = workload.AddOrder[zipfian(random)];
+		}
+		else
+		{
+			shuffle(shuffled.begin(), shuffled.end(), random);
+			workload.LookupOrder = shuffled;
+		}
+	}
+
+	return workload;
+}
+
+
+template <typename Tree>
+void RunTraversals(Tree &tree, const string &treeName, const string &distribution, size_t size)
+{
+	static const char *Orders[] = { "in_order", "pre_order", "post_order" };
+	static const TraversalMethod Methods[] = { TraverseRecursive, TraverseIterative, TraverseMorris };
+	static const char *MethodNames[] = { "recursive", "iterative", "morris" };
+
+	TreeHelper<int> helper;
+	vector<int> items;
+	items.reserve(size);
+
+	bool tooDeep = helper.MeasureShape(tree.GetRoot()).Height > MaxRecursionDepth;
+
+	for (int order = 0; order < 3; order++)
+	{
+		for (int method = 0; method < 3; method++)
+		{
+			if (Methods[method] == TraverseRecursive && tooDeep)
+				continue;
+
+			items.clear();
+			Stopwatch watch;
+
+			if (order == 0)
+				helper.ToVectorInOrder(tree.GetRoot(), items, Methods[method]);
+			else if (order == 1)
+				helper.ToVectorPreOrder(tree.GetRoot(), items, Methods[method]);
+			else
+				helper.ToVectorPostOrder(tree.GetRoot(), items, Methods[method]);
+
+			double seconds = watch.Seconds();
+			Sink = Sink + (long long)items.size();
+
+			string name = string("to_vector_") + Orders[order] + "_" + MethodNames[method];
+			Report(name.c_str(), treeName, distribution, size, size, seconds);
+		}
+
+		items.clear();
+		Stopwatch watch;
+
+		if (order == 0)
+			helper.ToVectorInOrderParallel(tree.GetRoot(), items);
+		else if (order == 1)
+			helper.ToVectorPreOrderParallel(tree.GetRoot(), items);
+		else
+			helper.ToVectorPostOrderParallel(tree.GetRoot(), items);
+
+		double seconds = watch.Seconds();
+		Sink = Sink + (long long)items.size();
+
+		string name = string("to_vector_") + Orders[order] + "_parallel";
+		Report(name.c_str(), treeName, distribution, size, size, seconds);
+	}
+}
+
+
+template <typename Tree>
+void RunTree(const string &treeName, const string &distribution, size_t size, const Workload &workload)
+{
+	Tree tree;
+	long long found = 0;
+
+	{
+		Stopwatch watch;
+		for (size_t i = 0; i < size; i++)
+			tree.Add(workload.AddOrder[i]);
+		Report("add", treeName, distribution, size, size, watch.Seconds());
+	}
+
+	{
+		Stopwatch watch;
+		for (size_t i = 0; i < size; i++)
+			found += tree.Contains(workload.LookupOrder[i]);
+		Report("contains", treeName, distribution, size, size, watch.Seconds());
+	}
+
+	RunTraversals(tree, treeName, distribution, size);
+
+	{
+		Stopwatch watch;
+		for (size_t i = 0; i < size; i++)
+			tree.Remove(workload.RemoveOrder[i]);
+		Report("remove", treeName, distribution, size, size, watch.Seconds());
+	}
+
+	// Clear gets a tree of its own, built the same way.
+	for (size_t i = 0; i < size; i++)
+		tree.Add(workload.AddOrder[i]);
+
+	{
+		Stopwatch watch;
+		tree.Clear();
+		Report("clear", treeName, distribution, size, size, watch.Seconds());
+	}
+
+	Sink = Sink + found;
+}
+
+
+vector<string> SplitList(const char *list)
+{
+	vector<string> items;
+	string item;
+
+	for (const char *c = list; ; c++)
+	{
+		if (*c == ',' || *c == '\0')
+		{
+			if (!item.empty())
+				items.push_back(item);
+			item.clear();
+
+			if (*c == '\0')
+				return items;
+		}
+		else
+			item += *c;
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	vector<string> sizes = SplitList("1000,10000,100000,1000000");
+	vector<string> distributions = SplitList("sorted,reverse,random,zipfian");
+	vector<string> trees = SplitList("plain,avl,pool,splay,cached");
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "--sizes=", 8) == 0)
+			sizes = SplitList(argv[i] + 8);
+		else if (strncmp(argv[i], "--distributions=", 16) == 0)
+			distributions = SplitList(argv[i] + 16);
+		else if (strncmp(argv[i], "--trees=", 8) == 0)
+			trees = SplitList(argv[i] + 8);
+		else
+		{
+			fprintf(stderr, "usage: %s [--sizes=N,...] [--distributions=sorted,reverse,random,zipfian] [--trees=plain,avl,pool,splay,cached]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for (size_t s = 0; s < sizes.size(); s++)
+	{
+		size_t size = (size_t)strtoull(sizes[s].c_str(), NULL, 10);
+
+		for (size_t d = 0; d < distributions.size(); d++)
+		{
+			const string &distribution = distributions[d];
+			if (distribution != "sorted" && distribution != "reverse" && distribution != "random" && distribution != "zipfian")
+			{
+				fprintf(stderr, "unknown distribution: %s\n", distribution.c_str());
+				return 1;
+			}
+
+			Workload workload = MakeWorkload(distribution, size);
+
+			for (size_t t = 0; t < trees.size(); t++)
+			{
+				const string &tree = trees[t];
+
+				if (tree == "plain")
+				{
+					if (size > MaxDegenerateSize && (distribution == "sorted" || distribution == "reverse"))
+						continue;
+
+					RunTree<BinaryTree<int> >(tree, distribution, size, workload);
+				}
+				else if (tree == "avl")
+					RunTree<BinaryTree<int, AvlBalance> >(tree, distribution, size, workload);
+				else if (tree == "pool")
+					RunTree<BinaryTree<int, AvlBalance, PoolNodeAllocator> >(tree, distribution, size, workload);
+				else if (tree == "splay")
+					RunTree<BinaryTree<int, SplayBalance> >(tree, distribution, size, workload);
+				else if (tree == "cached")
+					RunTree<BinaryTree<int, AvlBalance, HeapNodeAllocator, NoSubtreeSizes, NoTreeStats, LookupCache> >(tree, distribution, size, workload);
+				else
+				{
+					fprintf(stderr, "unknown tree: %s\n", tree.c_str());
+					return 1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
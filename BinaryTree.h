@@ -1,62 +1,660 @@
 #pragma once
 
 #include <vector>
+#include <utility>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
 
+#include "BinaryTreeNode.h"
+#include "TreeBalance.h"
+#include "SubtreeSizes.h"
+#include "TreeStats.h"
+#include "LookupCache.h"
+#include "TreeCompare.h"
+#include "NodeAllocator.h"
+#include "TreeIterator.h"
+#include "FrozenTree.h"
+#include "AlignedMemory.h"
 
 
 
-template <typename type>
+
+// The Balance parameter picks how the tree keeps itself in shape.  NoBalance
+// (the default) is a plain binary search tree; AvlBalance keeps the height
+// O(log n) through Add and Remove; SplayBalance moves whatever Add, Remove
+// and Contains touch to the root, which suits lookups that keep hitting a
+// few items.  See TreeBalance.h.
+//
+// The Allocator parameter decides where the nodes live.  HeapNodeAllocator
+// (the default) news each one; PoolNodeAllocator packs them into slabs owned
+// by the tree.  See NodeAllocator.h.
+//
+// The Sizes parameter decides whether every node knows how many items are
+// below it.  NoSubtreeSizes (the default) doesn't bother; SubtreeSizes pays a
+// little on Add and Remove so that Select and Rank take O(height) instead of
+// a walk over the whole tree.  See SubtreeSizes.h.
+//
+// The Stats parameter decides whether Add, Remove and Contains count their
+// comparisons, node visits, depth, allocations and rotations.  NoTreeStats
+// (the default) compiles to nothing; TreeStats keeps the counts, which
+// GetStats() returns.  See TreeStats.h.
+//
+// The Cache parameter decides whether Contains remembers recent answers.
+// NoLookupCache (the default) doesn't; LookupCache answers repeated lookups
+// of the same keys from a few cache lines, and GetLookupCache() reports its
+// hit rate.  See LookupCache.h.
+//
+// The Compare parameter orders the items.  std::less<type> (the default)
+// uses their operator<; a transparent comparator such as TransparentLess
+// also lets Contains, Remove and Find take keys of other types.  See
+// TreeCompare.h.
+template <typename type, typename Balance = NoBalance, template <typename> class Allocator = HeapNodeAllocator, typename Sizes = NoSubtreeSizes, typename Stats = NoTreeStats, template <typename> class Cache = NoLookupCache, typename Compare = std::less<type> >
 class BinaryTree
 {
 private:
-    struct BinaryTreeNode
-    {
-    public:
-        type Data;
-        BinaryTreeNode *Left;
-        BinaryTreeNode *Right;
-        
-        BinaryTreeNode(const type& data) :
-        Data(data),
-        Left(NULL),
-        Right(NULL)
-        {}
-        
-        type& GetData()
-        {
-            return Data;
-        }
-        
-    };
-    
-    BinaryTreeNode *_root;
+	BinaryTreeNode<type> *_root;
 	int _count;
+	Allocator<type> _allocator;
+
+	// Counting doesn't change the tree, so const searches can count too.
+	mutable Stats _stats;
+
+	Cache<type> _cache;
+	Compare _compare;
+
+	// FrozenTree and LookupCache compare items with operator< themselves, so
+	// they only agree with the tree when it is ordered by operator< too.
+	static const bool OrderedByOperatorLess = std::is_same<Compare, std::less<type> >::value || std::is_same<Compare, TransparentLess>::value;
+
+	static_assert(!Cache<type>::Enabled || OrderedByOperatorLess, "BinaryTree: LookupCache matches keys with operator< and std::hash, so the tree must be ordered by operator<.");
+
+	// The tree owns its nodes, so copying one would free them twice.
+	BinaryTree(const BinaryTree &);
+	BinaryTree &operator=(const BinaryTree &);
+
+
+	// Returns the node holding key, or NULL if it is not in the tree.  key
+	// is an item, or with a transparent comparator anything it can compare
+	// with one.  depth is set to how deep the search went, and last to the
+	// last node it looked at (NULL only if the tree is empty).
+	template <typename Key>
+	BinaryTreeNode<type> *FindNode(const Key &key, int &depth, BinaryTreeNode<type> *&last) const
+	{
+		BinaryTreeNode<type> *node = _root;
+		depth = 0;
+		last = NULL;
+
+		while (node != NULL)
+		{
+			last = node;
+			_stats.Visit(++depth);
+
+			if (_compare(key, node->Data))
+			{
+				_stats.Compare(1);
+				node = node->Left;
+			}
+			else if (_compare(node->Data, key))
+			{
+				_stats.Compare(2);
+				node = node->Right;
+			}
+			else
+			{
+				_stats.Compare(2);
+				return node;
+			}
+		}
+
+		return NULL;
+	}
+
+
+	// Returns the node with the smallest item that is not less than value
+	// (or, if strict, greater than value), or NULL if there is none.
+	BinaryTreeNode<type> *FindBound(const type &value, bool strict) const
+	{
+		BinaryTreeNode<type> *node = _root;
+		BinaryTreeNode<type> *bound = NULL;
+
+		while (node != NULL)
+		{
+			if (strict ? _compare(value, node->Data) : !_compare(node->Data, value))
+			{
+				bound = node;
+				node = node->Left;
+			}
+			else
+				node = node->Right;
+		}
+
+		return bound;
+	}
+
+
+	// CountInRange when the nodes know their subtree sizes.
+	int CountInRange(const type &low, const type &high, std::true_type) const
+	{
+		return Rank(high) - Rank(low);
+	}
+
+	// CountInRange when they don't: walk the items in the range.
+	int CountInRange(const type &low, const type &high, std::false_type) const
+	{
+		int count = 0;
+
+		for (iterator it = LowerBound(low), last = end(); it != last && _compare(*it, high); ++it)
+			count++;
+
+		return count;
+	}
+
+
+	// Finds the empty child link where newItem belongs and its parent.  Throws
+	// if newItem is already in the tree.
+	BinaryTreeNode<type> **FindInsertLink(const type &newItem, BinaryTreeNode<type> *&parent)
+	{
+		BinaryTreeNode<type> **link = &_root;
+		parent = NULL;
+		int depth = 0;
+
+		while (*link != NULL)
+		{
+			parent = *link;
+			_stats.Visit(++depth);
+
+			if (_compare(newItem, parent->Data))
+			{
+				_stats.Compare(1);
+				link = &parent->Left;
+			}
+			else if (_compare(parent->Data, newItem))
+			{
+				_stats.Compare(2);
+				link = &parent->Right;
+			}
+			else
+			{
+				_stats.Compare(2);
+				Balance::AfterAccess(_root, parent, _stats);
+				throw std::invalid_argument("BinaryTree::Add: the item is already in the tree.");
+			}
+		}
+
+		return link;
+	}
+
+
+	// Hangs a freshly created node off link and lets the balancing policy
+	// fix up the tree.
+	void Link(BinaryTreeNode<type> *node, BinaryTreeNode<type> *parent, BinaryTreeNode<type> **link)
+	{
+		node->Parent = parent;
+		*link = node;
+		_count++;
+		_cache.Update(node->Data, true);
+
+		// Sizes first: the balancing policy's rotations expect them right.
+		Sizes::AfterInsert(node);
+		Balance::AfterInsert(_root, node, _stats);
+	}
+
+
+	// Frees every node below and including node.  Left children are rotated
+	// up until the current node has none, then it is freed and the walk goes
+	// on with its right child.  This needs no stack, so it also works on trees
+	// that have degenerated into a long list.  Returns how many nodes it freed.
+	int DestroySubtree(BinaryTreeNode<type> *node)
+	{
+		int destroyed = 0;
+
+		while (node != NULL)
+		{
+			if (node->Left != NULL)
+			{
+				BinaryTreeNode<type> *left = node->Left;
+				node->Left = left->Right;
+				left->Right = node;
+				node = left;
+			}
+			else
+			{
+				BinaryTreeNode<type> *right = node->Right;
+				_allocator.Destroy(node);
+				node = right;
+				destroyed++;
+			}
+		}
+
+		return destroyed;
+	}
+
+
+	// Cuts node's subtrees loose so each can be worked on as a tree of its
+	// own.
+	static void Detach(BinaryTreeNode<type> *node, BinaryTreeNode<type> *&left, BinaryTreeNode<type> *&right)
+	{
+		left = node->Left;
+		right = node->Right;
+
+		if (left != NULL)
+			left->Parent = NULL;
+		if (right != NULL)
+			right->Parent = NULL;
+	}
+
+
+	// Splits the tree at root into the items below key (less) and the items
+	// above it (greater).  Returns key's own node, cut loose from both, or
+	// NULL if key isn't there.  It walks down to key, then back up through
+	// the Parent links joining each node on the way onto one side or the
+	// other, which for an AVL tree costs O(height) all told.
+	BinaryTreeNode<type> *SplitSubtree(BinaryTreeNode<type> *root, const type &key, BinaryTreeNode<type> *&less, BinaryTreeNode<type> *&greater)
+	{
+		BinaryTreeNode<type> *node = root;
+		BinaryTreeNode<type> *last = NULL;
+		BinaryTreeNode<type> *found = NULL;
+
+		while (node != NULL && found == NULL)
+		{
+			last = node;
+
+			if (_compare(key, node->Data))
+				node = node->Left;
+			else if (_compare(node->Data, key))
+				node = node->Right;
+			else
+				found = node;
+		}
+
+		less = NULL;
+		greater = NULL;
+		if (found != NULL)
+		{
+			last = found->Parent;
+			Detach(found, less, greater);
+		}
+
+		while (last != NULL)
+		{
+			BinaryTreeNode<type> *above = last->Parent;
+
+			if (_compare(key, last->Data))
+				greater = Balance::Join(greater, last, last->Right);
+			else
+				less = Balance::Join(last->Left, last, less);
+
+			last = above;
+		}
+
+		return found;
+	}
+
+
+	// Joins two trees where every item in left is smaller than every item in
+	// right.  The largest item in left is split off to go between them.
+	static BinaryTreeNode<type> *JoinSubtrees(BinaryTreeNode<type> *left, BinaryTreeNode<type> *right)
+	{
+		if (left == NULL)
+			return right;
+		if (right == NULL)
+			return left;
+
+		BinaryTreeNode<type> *largest = iterator::Rightmost(left);
+		BinaryTreeNode<type> *rest = largest->Left;
+
+		for (BinaryTreeNode<type> *node = largest->Parent; node != NULL; )
+		{
+			BinaryTreeNode<type> *above = node->Parent;
+			rest = Balance::Join(node->Left, node, rest);
+			node = above;
+		}
+
+		return Balance::Join(rest, largest, right);
+	}
+
+
+	// The set operations use up both trees, keeping a's nodes where they can
+	// and freeing the ones left out.  dropped goes up by one for every freed
+	// node the caller's count has to forget.
+	enum SetOperation
+	{
+		SetUnion,         // every item in a or b; where both have one, b's is freed
+		SetIntersection,  // the items in both a and b
+		SetDifference     // the items in a that are not in b
+	};
+
+	// One node of a, split off with the part of b on each side of it, whose
+	// left half has been (or is about to be) combined.
+	struct CombineFrame
+	{
+		BinaryTreeNode<type> *Node;
+		BinaryTreeNode<type> *Right;
+		BinaryTreeNode<type> *Greater;
+		BinaryTreeNode<type> *Left;
+		bool Keep;
+		bool LeftDone;
+	};
+
+
+	// The result of operation when a or b is empty.
+	BinaryTreeNode<type> *CombineEmpty(SetOperation operation, BinaryTreeNode<type> *a, BinaryTreeNode<type> *b, int &dropped)
+	{
+		if (operation == SetUnion)
+			return a == NULL ? b : a;
+
+		if (operation == SetIntersection)
+		{
+			dropped += DestroySubtree(a);
+			DestroySubtree(b);
+			return NULL;
+		}
+
+		DestroySubtree(b);
+		return a;
+	}
+
+
+	// Does operation on a and b and returns the result.  Each node of a
+	// splits b in two, the halves are combined with a's subtrees, and the
+	// results are joined back on either side of the node (or of nothing, if
+	// it doesn't belong).  The walk keeps its own stack of a's nodes rather
+	// than recursing, so a tall tree (a splay tree built from sorted items,
+	// say) can't overflow the call stack.
+	BinaryTreeNode<type> *CombineSubtrees(SetOperation operation, BinaryTreeNode<type> *a, BinaryTreeNode<type> *b, int &dropped)
+	{
+		std::vector<CombineFrame> stack;
+		BinaryTreeNode<type> *result;
+
+		while (true)
+		{
+			// Split down the left of a until one side runs out.
+			while (a != NULL && b != NULL)
+			{
+				CombineFrame frame;
+				BinaryTreeNode<type> *left, *less;
+
+				frame.Node = a;
+				Detach(a, left, frame.Right);
+
+				BinaryTreeNode<type> *match = SplitSubtree(b, a->Data, less, frame.Greater);
+				frame.Keep = operation == SetUnion || (operation == SetIntersection) == (match != NULL);
+				if (match != NULL)
+				{
+					_allocator.Destroy(match);
+					if (operation == SetUnion)
+						dropped++;
+				}
+
+				frame.Left = NULL;
+				frame.LeftDone = false;
+				stack.push_back(frame);
+
+				a = left;
+				b = less;
+			}
+
+			result = CombineEmpty(operation, a, b, dropped);
+
+			// Hand the result up until a node still has its right half to do.
+			while (true)
+			{
+				if (stack.empty())
+					return result;
+
+				CombineFrame &frame = stack.back();
+				if (!frame.LeftDone)
+				{
+					frame.Left = result;
+					frame.LeftDone = true;
+					a = frame.Right;
+					b = frame.Greater;
+					break;
+				}
+
+				if (frame.Keep)
+					result = Balance::Join(frame.Left, frame.Node, result);
+				else
+				{
+					_allocator.Destroy(frame.Node);
+					dropped++;
+					result = JoinSubtrees(frame.Left, result);
+				}
+
+				stack.pop_back();
+			}
+		}
+	}
+
+
+	// Counts the items in a subtree: straight from its size if the nodes
+	// keep one, otherwise by walking it.
+	static int CountSubtree(const BinaryTreeNode<type> *node, std::true_type)
+	{
+		return SubtreeSizes::SizeOf(node);
+	}
+
+	static int CountSubtree(BinaryTreeNode<type> *node, std::false_type)
+	{
+		int count = 0;
+
+		for (node = iterator::Leftmost(node); node != NULL; node = iterator::Successor(node))
+			count++;
+
+		return count;
+	}
+
+
+	// Builds a height-minimal subtree from the next size items, creating the
+	// nodes in order so first only ever moves forward.  The recursion is only
+	// O(log n) deep.
+	template <typename Iterator>
+	BinaryTreeNode<type> *BuildBalanced(Iterator &first, size_t size, BinaryTreeNode<type> *parent, int &height)
+	{
+		if (size == 0)
+		{
+			height = 0;
+			return NULL;
+		}
+
+		int leftHeight, rightHeight;
+		size_t leftSize = size / 2;
+		BinaryTreeNode<type> *left = BuildBalanced(first, leftSize, NULL, leftHeight);
+
+		BinaryTreeNode<type> *node;
+		try
+		{
+			node = _allocator.Create(*first);
+			++first;
+		}
+		catch (...)
+		{
+			DestroySubtree(left);
+			throw;
+		}
+
+		node->Parent = parent;
+		node->Left = left;
+		if (left != NULL)
+			left->Parent = node;
+
+		try
+		{
+			node->Right = BuildBalanced(first, size - leftSize - 1, node, rightHeight);
+		}
+		catch (...)
+		{
+			DestroySubtree(node);
+			throw;
+		}
+
+		height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+		node->Height = height;
+		node->Size = (int)size;
+		return node;
+	}
+
+
+	// Does the work of both Removes.  key is an item, or with a transparent
+	// comparator anything it can compare with one.
+	template <typename Key>
+	void RemoveKey(const Key &key)
+	{
+		_stats.Begin(OperationRemove);
+
+		int depth;
+		BinaryTreeNode<type> *last;
+		BinaryTreeNode<type> *node = FindNode(key, depth, last);
+		if (node == NULL)
+		{
+			Balance::AfterAccess(_root, last, _stats);
+			throw std::out_of_range("BinaryTree::Remove: the item is not in the tree.");
+		}
+
+		// The lowest node whose subtree changed, handed to the balancing
+		// policy so it can repair the path back up to the root.
+		BinaryTreeNode<type> *changed;
+
+		if (node->Left == NULL || node->Right == NULL)
+		{
+			changed = node->Parent;
+			TreeRotation::ReplaceChild(_root, node, node->Left != NULL ? node->Left : node->Right);
+		}
+		else
+		{
+			// Two children: relink the in-order successor into node's place
+			// rather than copying its data, so no payload is copied.
+			BinaryTreeNode<type> *successor = node->Right;
+			_stats.Visit(++depth);
+			while (successor->Left != NULL)
+			{
+				successor = successor->Left;
+				_stats.Visit(++depth);
+			}
+
+			if (successor->Parent != node)
+			{
+				changed = successor->Parent;
+				TreeRotation::ReplaceChild(_root, successor, successor->Right);
+				successor->Right = node->Right;
+				successor->Right->Parent = successor;
+			}
+			else
+			{
+				changed = successor;
+			}
+
+			TreeRotation::ReplaceChild(_root, node, successor);
+			successor->Left = node->Left;
+			successor->Left->Parent = successor;
+			successor->Height = node->Height;
+			successor->Size = node->Size;
+		}
+
+		_cache.Update(node->Data, false);
+		_allocator.Destroy(node);
+		_stats.Free();
+		_count--;
+
+		Sizes::AfterRemove(changed);
+		Balance::AfterRemove(_root, changed, _stats);
+	}
 
 public:
+	// In-order iterators.  Items can't be changed through them, so iterator
+	// and const_iterator are the same type.  See TreeIterator.h.
+	typedef TreeIterator<type> iterator;
+	typedef TreeIterator<type> const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<iterator> const_reverse_iterator;
+
 	BinaryTree() :
 		_root(NULL),
 		_count(0)
 	{}
 
+	// Builds the tree from a sorted range of unique items.  See
+	// BuildFromSorted.
+	template <typename Iterator>
+	BinaryTree(Iterator first, Iterator last) :
+		_root(NULL),
+		_count(0)
+	{
+		BuildFromSorted(first, last);
+	}
+
 
 	// Make sure you clean up everything in the destructor.  THe easiest way to
 	// do this is to call the Clear() method.
 	~BinaryTree()
 	{
+		Clear();
 	}
 
 
 	// This method returns a pointer to the root tree-node.
-	BinaryTreeNode *GetRoot()
+	BinaryTreeNode<type> *GetRoot()
 	{
 		return _root;
 	}
 
 
-	// This method will add a new item to the tree.  You need to check for 
+	// This method will add a new item to the tree.  You need to check for
 	// duplicates.  If you find a duplicate, you should throw an exception.
 	void Add(const type& newItem)
 	{
+		_stats.Begin(OperationAdd);
+
+		BinaryTreeNode<type> *parent;
+		BinaryTreeNode<type> **link = FindInsertLink(newItem, parent);
+
+		BinaryTreeNode<type> *node = _allocator.Create(newItem);
+		_stats.Allocate();
+		Link(node, parent, link);
+	}
+
+
+	// Same as Add, but moves the item into the tree instead of copying it.
+	void Add(type&& newItem)
+	{
+		_stats.Begin(OperationAdd);
+
+		BinaryTreeNode<type> *parent;
+		BinaryTreeNode<type> **link = FindInsertLink(newItem, parent);
+
+		BinaryTreeNode<type> *node = _allocator.Create(std::move(newItem));
+		_stats.Allocate();
+		Link(node, parent, link);
+	}
+
+
+	// Builds the item in place inside a new node from args, then adds it.  The
+	// node has to exist before the item can be compared, so a duplicate costs
+	// one node that is freed again before the exception is thrown.
+	template <typename... Args>
+	void Emplace(Args&&... args)
+	{
+		_stats.Begin(OperationAdd);
+
+		BinaryTreeNode<type> *node = _allocator.Create(std::forward<Args>(args)...);
+		_stats.Allocate();
+
+		BinaryTreeNode<type> *parent;
+		BinaryTreeNode<type> **link;
+
+		try
+		{
+			link = FindInsertLink(node->Data, parent);
+		}
+		catch (...)
+		{
+			_allocator.Destroy(node);
+			_stats.Free();
+			throw;
+		}
+
+		Link(node, parent, link);
 	}
 
 
@@ -65,20 +663,368 @@ public:
 	// not in the tree, then throw an exception.
 	void Remove(const type &value)
 	{
+		RemoveKey(value);
+	}
+
+	// Same as Remove, for a key the comparator can compare with the items
+	// without it being turned into one first.  Only there with a transparent
+	// comparator.
+	template <typename Key, typename C = Compare, typename = typename C::is_transparent>
+	void Remove(const Key &key)
+	{
+		RemoveKey(key);
 	}
 
 
 	// This method should return a count of how many items are in your tree.
 	int Count()
 	{
-        return 0;
+		return _count;
 	}
 
 
-	// This method will return a true if the item is a member of the tree, and 
+	// This method will return a true if the item is a member of the tree, and
 	// false if the item is not in the tree.
 	bool Contains(const type &value)
-    {return true;
+	{
+		_stats.Begin(OperationContains);
+
+		bool present;
+		if (_cache.Lookup(value, present))
+			return present;
+
+		int depth;
+		BinaryTreeNode<type> *last;
+		BinaryTreeNode<type> *node = FindNode(value, depth, last);
+
+		Balance::AfterAccess(_root, last, _stats);
+		_cache.Remember(value, node != NULL);
+		return node != NULL;
+	}
+
+	// Same as Contains, for a key the comparator can compare with the items
+	// without it being turned into one first.  Only there with a transparent
+	// comparator.  The LookupCache holds items, so it isn't used.
+	template <typename Key, typename C = Compare, typename = typename C::is_transparent>
+	bool Contains(const Key &key)
+	{
+		_stats.Begin(OperationContains);
+
+		int depth;
+		BinaryTreeNode<type> *last;
+		BinaryTreeNode<type> *node = FindNode(key, depth, last);
+
+		Balance::AfterAccess(_root, last, _stats);
+		return node != NULL;
+	}
+
+
+	// Returns an iterator to the item equal to value, or end() if there is
+	// none.  Like std::set::find.  It is a const search, so it neither
+	// splays nor uses the LookupCache.
+	iterator Find(const type &value) const
+	{
+		_stats.Begin(OperationContains);
+
+		int depth;
+		BinaryTreeNode<type> *last;
+		return iterator(FindNode(value, depth, last), &_root);
+	}
+
+	// Same as Find, for a key the comparator can compare with the items.
+	// Only there with a transparent comparator.
+	template <typename Key, typename C = Compare, typename = typename C::is_transparent>
+	iterator Find(const Key &key) const
+	{
+		_stats.Begin(OperationContains);
+
+		int depth;
+		BinaryTreeNode<type> *last;
+		return iterator(FindNode(key, depth, last), &_root);
+	}
+
+
+	// Returns what the Stats policy has counted.  With NoTreeStats there is
+	// nothing to read.
+	const Stats &GetStats() const
+	{
+		return _stats;
+	}
+
+	// Starts the counts over from zero.
+	void ResetStats()
+	{
+		_stats.Reset();
+	}
+
+
+	// Returns the Contains cache, whose hit and miss counts are for tuning.
+	// With NoLookupCache there is nothing to read.
+	Cache<type> &GetLookupCache()
+	{
+		return _cache;
+	}
+
+
+	// Returns the k-th smallest item, counting from 0.  Throws if k is not
+	// less than Count().  Needs a tree built with SubtreeSizes.
+	const type &Select(int k) const
+	{
+		static_assert(Sizes::Enabled, "BinaryTree::Select needs the SubtreeSizes policy.");
+
+		if (k < 0 || k >= _count)
+			throw std::out_of_range("BinaryTree::Select: there is no item at that position.");
+
+		const BinaryTreeNode<type> *node = _root;
+		while (true)
+		{
+			int leftSize = SubtreeSizes::SizeOf(node->Left);
+
+			if (k < leftSize)
+				node = node->Left;
+			else if (k > leftSize)
+			{
+				k -= leftSize + 1;
+				node = node->Right;
+			}
+			else
+				return node->Data;
+		}
+	}
+
+
+	// Returns how many items in the tree are smaller than value, which
+	// doesn't have to be in the tree itself.  When it is, this is its
+	// position for Select.  Needs a tree built with SubtreeSizes.
+	int Rank(const type &value) const
+	{
+		static_assert(Sizes::Enabled, "BinaryTree::Rank needs the SubtreeSizes policy.");
+
+		const BinaryTreeNode<type> *node = _root;
+		int rank = 0;
+
+		while (node != NULL)
+		{
+			if (_compare(value, node->Data))
+				node = node->Left;
+			else if (_compare(node->Data, value))
+			{
+				rank += SubtreeSizes::SizeOf(node->Left) + 1;
+				node = node->Right;
+			}
+			else
+				return rank + SubtreeSizes::SizeOf(node->Left);
+		}
+
+		return rank;
+	}
+
+
+	// Moves every item that is not less than key into greater, replacing
+	// whatever greater held.  The nodes themselves move, so nothing is copied,
+	// and with AvlBalance it takes O(log n) plus, without SubtreeSizes, a
+	// walk over the items that moved to recount them.  Needs an allocator
+	// whose nodes can move between trees.
+	void Split(const type &key, BinaryTree &greater)
+	{
+		static_assert(Allocator<type>::NodesMoveFreely, "BinaryTree::Split needs an allocator whose nodes can change trees.");
+
+		if (&greater == this)
+			throw std::invalid_argument("BinaryTree::Split: a tree can't split into itself.");
+
+		greater.Clear();
+
+		BinaryTreeNode<type> *less, *more;
+		BinaryTreeNode<type> *found = SplitSubtree(_root, key, less, more);
+		if (found != NULL)
+			more = Balance::Join((BinaryTreeNode<type> *)NULL, found, more);
+
+		int moved = CountSubtree(more, std::integral_constant<bool, Sizes::Enabled>());
+
+		_root = less;
+		_count -= moved;
+		_cache.Clear();
+		greater._root = more;
+		greater._count = moved;
+	}
+
+
+	// Moves every item in greater onto the end of this tree, leaving greater
+	// empty.  Every item in greater must be larger than every item here;
+	// throws (and changes nothing) if not.  With AvlBalance this takes
+	// O(log n).
+	void Join(BinaryTree &greater)
+	{
+		if (&greater == this || greater._root == NULL)
+			return;
+
+		if (_root != NULL && !_compare(iterator::Rightmost(_root)->Data, iterator::Leftmost(greater._root)->Data))
+			throw std::invalid_argument("BinaryTree::Join: the items to join must all be larger than the ones in the tree.");
+
+		_allocator.Adopt(greater._allocator);
+		_root = JoinSubtrees(_root, greater._root);
+		_count += greater._count;
+		_cache.Clear();
+
+		greater._root = NULL;
+		greater._count = 0;
+		greater._cache.Clear();
+	}
+
+
+	// Set operations.  Each one turns this tree into the result and leaves
+	// other empty.  No item is copied: the nodes that make it into the
+	// result are relinked, and where both trees hold an item it is this
+	// tree's that is kept.  With AvlBalance they take O(m log(n/m + 1)) for
+	// trees of m and n >= m items, rather than the O(n + m) of dumping both
+	// and rebuilding.
+
+	// Keeps every item that is in either tree.
+	void UnionWith(BinaryTree &other)
+	{
+		if (&other == this)
+			return;
+
+		int dropped = 0;
+		_allocator.Adopt(other._allocator);
+		_root = CombineSubtrees(SetUnion, _root, other._root, dropped);
+		_count += other._count - dropped;
+		_cache.Clear();
+
+		other._root = NULL;
+		other._count = 0;
+		other._cache.Clear();
+	}
+
+	// Keeps only the items that are in both trees.
+	void IntersectWith(BinaryTree &other)
+	{
+		if (&other == this)
+			return;
+
+		int dropped = 0;
+		_allocator.Adopt(other._allocator);
+		_root = CombineSubtrees(SetIntersection, _root, other._root, dropped);
+		_count -= dropped;
+		_cache.Clear();
+
+		other._root = NULL;
+		other._count = 0;
+		other._cache.Clear();
+	}
+
+	// Keeps only the items that are not in other.
+	void DifferenceWith(BinaryTree &other)
+	{
+		if (&other == this)
+		{
+			Clear();
+			return;
+		}
+
+		int dropped = 0;
+		_allocator.Adopt(other._allocator);
+		_root = CombineSubtrees(SetDifference, _root, other._root, dropped);
+		_count -= dropped;
+		_cache.Clear();
+
+		other._root = NULL;
+		other._count = 0;
+		other._cache.Clear();
+	}
+
+
+	// Returns an iterator to the first item that is not less than value, or
+	// end() if there is none.  Like std::set::lower_bound.
+	iterator LowerBound(const type &value) const
+	{
+		return iterator(FindBound(value, false), &_root);
+	}
+
+
+	// Returns an iterator to the first item greater than value, or end() if
+	// there is none.  Like std::set::upper_bound.
+	iterator UpperBound(const type &value) const
+	{
+		return iterator(FindBound(value, true), &_root);
+	}
+
+
+	// Returns how many items are at least low and less than high.  Takes
+	// O(height) with SubtreeSizes; otherwise it also walks the k items it
+	// counts.
+	int CountInRange(const type &low, const type &high) const
+	{
+		if (!_compare(low, high))
+			return 0;
+
+		return CountInRange(low, high, std::integral_constant<bool, Sizes::Enabled>());
+	}
+
+
+	// Calls visit(item) on every item that is at least low and less than high,
+	// smallest first.  Only the O(height + k) nodes on the way to low and
+	// inside the range are touched.  To stop partway, walk from LowerBound
+	// with an iterator instead.
+	template <typename Visitor>
+	void VisitRange(const type &low, const type &high, Visitor visit) const
+	{
+		for (iterator it = LowerBound(low), last = end(); it != last && _compare(*it, high); ++it)
+			visit(*it);
+	}
+
+
+	// Sets out[i] to Contains(keys[i]) for each of the n keys.  Rather than
+	// finishing one search before starting the next, it walks a group of
+	// searches down the tree one level at a time and prefetches each one's
+	// next node, so the cache misses of the whole group overlap instead of
+	// being paid one after another.
+	void ContainsBatch(const type *keys, size_t n, bool *out)
+	{
+		const size_t GroupSize = 16;
+		const BinaryTreeNode<type> *cursors[GroupSize];
+
+		for (size_t first = 0; first < n; first += GroupSize)
+		{
+			size_t group = n - first < GroupSize ? n - first : GroupSize;
+			for (size_t i = 0; i < group; i++)
+			{
+				cursors[i] = _root;
+				out[first + i] = false;
+			}
+
+			bool active = _root != NULL;
+			while (active)
+			{
+				active = false;
+
+				for (size_t i = 0; i < group; i++)
+				{
+					const BinaryTreeNode<type> *node = cursors[i];
+					if (node == NULL)
+						continue;
+
+					const type &key = keys[first + i];
+					if (_compare(key, node->Data))
+						node = node->Left;
+					else if (_compare(node->Data, key))
+						node = node->Right;
+					else
+					{
+						out[first + i] = true;
+						node = NULL;
+					}
+
+					if (node != NULL)
+					{
+						Prefetch(node);
+						active = true;
+					}
+
+					cursors[i] = node;
+				}
+			}
+		}
 	}
 
 
@@ -86,5 +1032,87 @@ public:
 	// zero.
 	void Clear()
 	{
+		// If the allocator can drop all of its memory at once and the items
+		// have nothing to clean up, there is no need to visit the nodes.
+		if (!(Allocator<type>::ReleasesInBulk && std::is_trivially_destructible<type>::value))
+			DestroySubtree(_root);
+
+		_allocator.Reset();
+		_root = NULL;
+		_count = 0;
+		_cache.Clear();
+	}
+
+
+	// Replaces the contents of the tree with the items in [first, last), which
+	// must be sorted and free of duplicates.  The result is as balanced as a
+	// tree can be and takes O(n) time, with no comparisons beyond the check
+	// of the input.  Throws (and leaves the tree untouched) if the input is
+	// out of order or has a duplicate.
+	template <typename Iterator>
+	void BuildFromSorted(Iterator first, Iterator last)
+	{
+		size_t size = 0;
+		if (first != last)
+		{
+			size = 1;
+			Iterator previous = first;
+			for (Iterator it = previous; ++it != last; previous = it, size++)
+			{
+				if (_compare(*it, *previous))
+					throw std::invalid_argument("BinaryTree::BuildFromSorted: the items are not sorted.");
+				if (!_compare(*previous, *it))
+					throw std::invalid_argument("BinaryTree::BuildFromSorted: the items contain a duplicate.");
+			}
+		}
+
+		Clear();
+
+		int height;
+		_root = BuildBalanced(first, size, NULL, height);
+		_count = (int)size;
+	}
+
+
+	// Copies the items into a read-only FrozenTree, which answers Contains
+	// and LowerBound without chasing Left/Right pointers.  The frozen copy
+	// does not see later changes to this tree.
+	FrozenTree<type> Freeze() const
+	{
+		static_assert(OrderedByOperatorLess, "BinaryTree::Freeze: FrozenTree searches with operator<, so the tree must be ordered by it.");
+
+		return FrozenTree<type>(begin(), (size_t)_count);
+	}
+
+
+	// Writes the items to path so that a MappedTree can open and search them
+	// later without rebuilding anything.  See FrozenTree::Save.
+	void Save(const char *path) const
+	{
+		Freeze().Save(path);
+	}
+
+
+	// Iterators over the items in order, smallest first.  Walking them copies
+	// nothing and allocates nothing.
+	iterator begin() const
+	{
+		return iterator(iterator::Leftmost(_root), &_root);
+	}
+
+	iterator end() const
+	{
+		return iterator(NULL, &_root);
+	}
+
+	// Iterators over the items in order, largest first.
+	reverse_iterator rbegin() const
+	{
+		return reverse_iterator(end());
+	}
+
+	reverse_iterator rend() const
+	{
+		return reverse_iterator(begin());
 	}
 };
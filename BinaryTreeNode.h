@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdlib.h>
+#include <utility>
+
+
+
+
+template <typename type>
+struct BinaryTreeNode
+{
+public:
+	type Data;
+	BinaryTreeNode *Left;
+	BinaryTreeNode *Right;
+	BinaryTreeNode *Parent;
+
+	// Height of the subtree rooted at this node (a leaf is 1).  Only the
+	// balancing policies that need it keep this up to date.
+	int Height;
+
+	// Number of items in the subtree rooted at this node, counting itself.
+	// Only kept up to date by trees built with SubtreeSizes.
+	int Size;
+
+	// The arguments are passed straight on to type's constructor, so the item
+	// can be copied, moved or built in place inside the node.
+	template <typename... Args>
+	explicit BinaryTreeNode(Args&&... args) :
+		Data(std::forward<Args>(args)...),
+		Left(NULL),
+		Right(NULL),
+		Parent(NULL),
+		Height(1),
+		Size(1)
+	{}
+
+	type& GetData()
+	{
+		return Data;
+	}
+};
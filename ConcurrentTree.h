@@ -0,0 +1,241 @@
+#pragma once
+
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <stdexcept>
+
+#include "EpochReclaimer.h"
+
+
+
+
+template <typename type>
+struct ConcurrentTreeNode
+{
+public:
+	type Data;
+	std::atomic<ConcurrentTreeNode *> Left;
+	std::atomic<ConcurrentTreeNode *> Right;
+
+	template <typename... Args>
+	explicit ConcurrentTreeNode(Args&&... args) :
+		Data(std::forward<Args>(args)...),
+		Left(NULL),
+		Right(NULL)
+	{}
+};
+
+
+// A binary search tree that any number of threads can call Contains and
+// Count on while another thread calls Add, Remove and Clear.  Readers take no
+// locks: they follow the child links with acquire loads, and the writer only
+// ever publishes fully built nodes.  Writers are serialized by a mutex.
+//
+// A node that Remove unlinks may still be under a reader, so it is retired to
+// an EpochReclaimer and only freed once every reader that could have seen it
+// has finished.  The tree doesn't rotate (a rotation would let a reader miss
+// a key that never left the tree), so it has BinaryTree's plain shape.
+//
+// Removing a node with two children copies its in-order successor into a new
+// node that takes its place, so type must be copy constructible.
+template <typename type>
+class ConcurrentTree
+{
+private:
+	typedef ConcurrentTreeNode<type> Node;
+
+	std::atomic<Node *> _root;
+	std::atomic<int> _count;
+	std::mutex _writeLock;
+	EpochReclaimer _reclaimer;
+
+	ConcurrentTree(const ConcurrentTree &);
+	ConcurrentTree &operator=(const ConcurrentTree &);
+
+
+	static void DeleteNode(void *node)
+	{
+		delete static_cast<Node *>(node);
+	}
+
+	// Frees a whole unlinked subtree without recursion, the same way
+	// BinaryTree::Clear does.
+	static void DeleteSubtree(void *subtree)
+	{
+		Node *node = static_cast<Node *>(subtree);
+
+		while (node != NULL)
+		{
+			Node *left = node->Left.load(std::memory_order_relaxed);
+			if (left != NULL)
+			{
+				node->Left.store(left->Right.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				left->Right.store(node, std::memory_order_relaxed);
+				node = left;
+			}
+			else
+			{
+				Node *right = node->Right.load(std::memory_order_relaxed);
+				delete node;
+				node = right;
+			}
+		}
+	}
+
+
+	// Finds the link that points at value's node, or at the empty spot where
+	// it would go.  Only called by the writer, which is the only thread that
+	// changes links, so relaxed loads see everything.
+	std::atomic<Node *> *FindLink(const type &value)
+	{
+		std::atomic<Node *> *link = &_root;
+
+		while (true)
+		{
+			Node *node = link->load(std::memory_order_relaxed);
+			if (node == NULL)
+				return link;
+
+			if (value < node->Data)
+				link = &node->Left;
+			else if (node->Data < value)
+				link = &node->Right;
+			else
+				return link;
+		}
+	}
+
+
+	template <typename Item>
+	void Insert(Item &&newItem)
+	{
+		std::lock_guard<std::mutex> guard(_writeLock);
+
+		std::atomic<Node *> *link = FindLink(newItem);
+		if (link->load(std::memory_order_relaxed) != NULL)
+			throw std::invalid_argument("ConcurrentTree::Add: the item is already in the tree.");
+
+		// The release store publishes the node only after it is fully built.
+		link->store(new Node(std::forward<Item>(newItem)), std::memory_order_release);
+		_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+public:
+	ConcurrentTree() :
+		_root(NULL),
+		_count(0)
+	{}
+
+	// No reader or writer may still be using the tree.
+	~ConcurrentTree()
+	{
+		DeleteSubtree(_root.load(std::memory_order_relaxed));
+	}
+
+
+	// Adds a new item to the tree.  Throws if the item is already there.
+	void Add(const type &newItem)
+	{
+		Insert(newItem);
+	}
+
+	void Add(type &&newItem)
+	{
+		Insert(std::move(newItem));
+	}
+
+
+	// Removes an item from the tree.  Throws if the item is not there.
+	void Remove(const type &value)
+	{
+		std::lock_guard<std::mutex> guard(_writeLock);
+
+		std::atomic<Node *> *link = FindLink(value);
+		Node *node = link->load(std::memory_order_relaxed);
+		if (node == NULL)
+			throw std::out_of_range("ConcurrentTree::Remove: the item is not in the tree.");
+
+		Node *left = node->Left.load(std::memory_order_relaxed);
+		Node *right = node->Right.load(std::memory_order_relaxed);
+
+		if (left == NULL || right == NULL)
+		{
+			// A reader already on node still reaches the same child.
+			link->store(left != NULL ? left : right, std::memory_order_release);
+		}
+		else if (right->Left.load(std::memory_order_relaxed) == NULL)
+		{
+			// The successor is node's right child: give it node's left
+			// subtree, then swing the link past node.
+			right->Left.store(left, std::memory_order_release);
+			link->store(right, std::memory_order_release);
+		}
+		else
+		{
+			// Put a copy of the successor where node was.  Until every reader
+			// that started under the old node has finished, the original
+			// successor has to stay where they can find it.
+			std::atomic<Node *> *successorLink = &right->Left;
+			Node *successor = successorLink->load(std::memory_order_relaxed);
+			for (Node *next; (next = successor->Left.load(std::memory_order_relaxed)) != NULL; successor = next)
+				successorLink = &successor->Left;
+
+			Node *replacement = new Node(successor->Data);
+			replacement->Left.store(left, std::memory_order_relaxed);
+			replacement->Right.store(right, std::memory_order_relaxed);
+			link->store(replacement, std::memory_order_release);
+
+			_reclaimer.Synchronize();
+
+			successorLink->store(successor->Right.load(std::memory_order_relaxed), std::memory_order_release);
+			_reclaimer.Retire(successor, DeleteNode);
+		}
+
+		_reclaimer.Retire(node, DeleteNode);
+		_count.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+
+	// Returns the number of items in the tree.
+	int Count()
+	{
+		return _count.load(std::memory_order_relaxed);
+	}
+
+
+	// Returns true if the item is in the tree.  Never blocks, even while a
+	// writer is changing the tree.
+	bool Contains(const type &value)
+	{
+		EpochReclaimer::ReadGuard guard(_reclaimer);
+		const Node *node = _root.load(std::memory_order_acquire);
+
+		while (node != NULL)
+		{
+			if (value < node->Data)
+				node = node->Left.load(std::memory_order_acquire);
+			else if (node->Data < value)
+				node = node->Right.load(std::memory_order_acquire);
+			else
+				return true;
+		}
+
+		return false;
+	}
+
+
+	// Deletes every item in the tree.  Readers already inside the old tree
+	// finish their walk before its nodes are freed.
+	void Clear()
+	{
+		std::lock_guard<std::mutex> guard(_writeLock);
+
+		Node *oldRoot = _root.exchange(NULL, std::memory_order_acq_rel);
+		_count.store(0, std::memory_order_relaxed);
+
+		if (oldRoot != NULL)
+			_reclaimer.Retire(oldRoot, DeleteSubtree);
+	}
+};
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+#include "AlignedMemory.h"
+
+
+
+
+// Hands every thread that reads a concurrent tree a small number of its own,
+// so each reader can announce itself in a fixed slot without locking.  The
+// number goes back to the pool when the thread exits.
+class ReaderSlots
+{
+public:
+	static const int MaxThreads = 128;
+
+	// Returns the calling thread's slot number.  Throws if more than
+	// MaxThreads threads are reading at once.
+	static int ThisThread()
+	{
+		static thread_local Holder holder;
+		return holder.Slot;
+	}
+
+private:
+	struct Holder
+	{
+		int Slot;
+
+		Holder() :
+			Slot(Acquire())
+		{}
+
+		~Holder()
+		{
+			Release(Slot);
+		}
+	};
+
+	static std::mutex &Lock()
+	{
+		static std::mutex lock;
+		return lock;
+	}
+
+	static std::vector<bool> &InUse()
+	{
+		static std::vector<bool> inUse(MaxThreads, false);
+		return inUse;
+	}
+
+	static int Acquire()
+	{
+		std::lock_guard<std::mutex> guard(Lock());
+		std::vector<bool> &inUse = InUse();
+
+		for (int i = 0; i < MaxThreads; i++)
+		{
+			if (!inUse[i])
+			{
+				inUse[i] = true;
+				return i;
+			}
+		}
+
+		throw std::runtime_error("ReaderSlots: too many reader threads.");
+	}
+
+	static void Release(int slot)
+	{
+		std::lock_guard<std::mutex> guard(Lock());
+		InUse()[slot] = false;
+	}
+};
+
+
+// Epoch-based reclamation.  Readers wrap each lookup in a ReadGuard, which
+// records the global epoch in the thread's slot for as long as it lives.  A
+// writer that unlinks something hands it to Retire() instead of freeing it;
+// it is stamped with the current epoch, the epoch moves on, and the object
+// is only really freed once no reader is still inside an epoch that old.
+// Readers never block and never write anything another reader touches.
+//
+// Retire() and Synchronize() must only be called by one thread at a time
+// (the tree's writer), and never from inside a ReadGuard.
+class EpochReclaimer
+{
+public:
+	typedef void (*Deleter)(void *object);
+
+	class ReadGuard
+	{
+	private:
+		std::atomic<uint64_t> &_slot;
+
+		ReadGuard(const ReadGuard &);
+		ReadGuard &operator=(const ReadGuard &);
+
+	public:
+		ReadGuard(EpochReclaimer &reclaimer) :
+			_slot(reclaimer._slots[ReaderSlots::ThisThread()].Epoch)
+		{
+			// The fence pairs with the one in OldestActiveEpoch: either the
+			// writer sees this slot, or this reader sees everything the
+			// writer unlinked before it looked.
+			_slot.store(reclaimer._epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+
+		~ReadGuard()
+		{
+			_slot.store(Quiescent, std::memory_order_release);
+		}
+	};
+
+private:
+	// A slot holding this is not reading.  Real epochs start at 1.
+	static const uint64_t Quiescent = 0;
+
+	// Retired objects are collected in batches of this many.
+	static const size_t ReclaimBatch = 64;
+
+	struct Slot
+	{
+		std::atomic<uint64_t> Epoch;
+		char Padding[CacheLineSize - sizeof(std::atomic<uint64_t>)];
+	};
+
+	struct RetiredObject
+	{
+		void *Object;
+		Deleter Delete;
+		uint64_t Epoch;
+	};
+
+	Slot _slots[ReaderSlots::MaxThreads];
+	std::atomic<uint64_t> _epoch;
+	std::vector<RetiredObject> _retired;
+
+	EpochReclaimer(const EpochReclaimer &);
+	EpochReclaimer &operator=(const EpochReclaimer &);
+
+
+	// The oldest epoch any reader is still in, or the current epoch if no
+	// reader is active.
+	uint64_t OldestActiveEpoch() const
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		uint64_t oldest = _epoch.load(std::memory_order_relaxed);
+
+		for (int i = 0; i < ReaderSlots::MaxThreads; i++)
+		{
+			// Acquire pairs with the release in ~ReadGuard, so a reader's last
+			// look at a node happens before the node is freed.
+			uint64_t epoch = _slots[i].Epoch.load(std::memory_order_acquire);
+			if (epoch != Quiescent && epoch < oldest)
+				oldest = epoch;
+		}
+
+		return oldest;
+	}
+
+public:
+	EpochReclaimer() :
+		_epoch(1)
+	{
+		for (int i = 0; i < ReaderSlots::MaxThreads; i++)
+			_slots[i].Epoch.store(Quiescent, std::memory_order_relaxed);
+	}
+
+	// No reader may be active once the owner is being destroyed, so
+	// everything still retired can go.
+	~EpochReclaimer()
+	{
+		for (size_t i = 0; i < _retired.size(); i++)
+			_retired[i].Delete(_retired[i].Object);
+	}
+
+
+	// Schedules object to be passed to deleter once every reader that might
+	// still see it has finished.  object must already be unreachable for new
+	// readers.
+	void Retire(void *object, Deleter deleter)
+	{
+		RetiredObject retired = { object, deleter, _epoch.fetch_add(1, std::memory_order_acq_rel) };
+		_retired.push_back(retired);
+
+		if (_retired.size() >= ReclaimBatch)
+			Reclaim();
+	}
+
+
+	// Frees every retired object no reader can still be looking at.
+	void Reclaim()
+	{
+		uint64_t oldest = OldestActiveEpoch();
+		size_t kept = 0;
+
+		for (size_t i = 0; i < _retired.size(); i++)
+		{
+			if (_retired[i].Epoch < oldest)
+				_retired[i].Delete(_retired[i].Object);
+			else
+				_retired[kept++] = _retired[i];
+		}
+
+		_retired.resize(kept);
+	}
+
+
+	// Waits until every reader that was active when this was called has
+	// finished.  Readers that start afterwards don't hold it up.
+	void Synchronize()
+	{
+		uint64_t target = _epoch.fetch_add(1, std::memory_order_acq_rel);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		for (int i = 0; i < ReaderSlots::MaxThreads; i++)
+		{
+			while (true)
+			{
+				uint64_t epoch = _slots[i].Epoch.load(std::memory_order_acquire);
+				if (epoch == Quiescent || epoch > target)
+					break;
+
+				std::this_thread::yield();
+			}
+		}
+	}
+};
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <new>
+#include <utility>
+#include <stdexcept>
+
+#include "AlignedMemory.h"
+#include "TreeFile.h"
+
+
+
+
+// The searches over an Eytzinger array, shared by FrozenTree and MappedTree.
+// slots[1..count] hold the items; slots[0] is never looked at.
+template <typename type>
+struct EytzingerLayout
+{
+	// Slot k * PrefetchStride is where the descendants four levels down start
+	// for small items; for bigger ones it is still a useful distance ahead.
+	static const size_t PrefetchStride = sizeof(type) >= CacheLineSize / 16 ? 16 : CacheLineSize / sizeof(type);
+
+
+	// Follows the search for value to the bottom of the tree, then undoes the
+	// final run of right turns to land on the first item not less than value.
+	// Returns slot 0 if every item is less than value.
+	static size_t LowerBoundSlot(const type *slots, size_t count, const type &value)
+	{
+		size_t slot = 1;
+
+		while (slot <= count)
+		{
+			Prefetch(reinterpret_cast<const void *>(reinterpret_cast<uintptr_t>(slots) + slot * PrefetchStride * sizeof(type)));
+			slot = 2 * slot + (slots[slot] < value);
+		}
+
+		// Drop the trailing 1 bits (right turns) and the 0 bit above them.
+		slot >>= TrailingOnes(slot) + 1;
+		return slot;
+	}
+
+
+	// The slot of the next item in order, or 0 after the last one.
+	static size_t NextSlot(size_t slot, size_t count)
+	{
+		if (2 * slot + 1 <= count)
+		{
+			slot = 2 * slot + 1;
+			while (2 * slot <= count)
+				slot *= 2;
+
+			return slot;
+		}
+
+		// Back up past the right turns, then once more.
+		return slot >> (TrailingOnes(slot) + 1);
+	}
+
+
+	// Calls visit(item) on every item that is at least low and less than
+	// high, smallest first.
+	template <typename Visitor>
+	static void VisitRange(const type *slots, size_t count, const type &low, const type &high, Visitor visit)
+	{
+		for (size_t slot = LowerBoundSlot(slots, count, low); slot != 0 && slots[slot] < high; slot = NextSlot(slot, count))
+			visit(slots[slot]);
+	}
+
+
+	static int TrailingOnes(size_t value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_ctzll(~(unsigned long long)value);
+#else
+		int ones = 0;
+		for (; value & 1; value >>= 1)
+			ones++;
+		return ones;
+#endif
+	}
+};
+
+
+// A read-only copy of a tree's items laid out in Eytzinger (breadth-first)
+// order: the root is in slot 1 and the children of slot k are in slots 2k and
+// 2k + 1.  A search just computes the next slot instead of loading a child
+// pointer, the top levels of every search share the same few cache lines,
+// and each step picks its direction with arithmetic rather than a branch.
+// The array is cache-line aligned, so the 16 descendants four levels below a
+// slot sit together in memory and can be prefetched in one go.
+//
+// Build one with BinaryTree::Freeze() or from any sorted range.  Save()
+// writes the array to a file that MappedTree can search in place.
+template <typename type>
+class FrozenTree
+{
+private:
+	// Slot 0 is never used; slots 1..count hold the items.
+	type *_slots;
+	size_t _count;
+
+	typedef EytzingerLayout<type> Layout;
+
+	FrozenTree(const FrozenTree &);
+	FrozenTree &operator=(const FrozenTree &);
+
+
+	// Fills the subtree at slot in order from first, which only moves forward,
+	// counting the items built so far in built.  Recursion is only as deep as
+	// the tree is tall.
+	template <typename Iterator>
+	void Fill(size_t slot, Iterator &first, size_t &built)
+	{
+		if (slot > _count)
+			return;
+
+		Fill(2 * slot, first, built);
+
+		new (&_slots[slot]) type(*first);
+		++first;
+		built++;
+
+		Fill(2 * slot + 1, first, built);
+	}
+
+	// Destroys the first remaining items in the order Fill built them.
+	void Unfill(size_t slot, size_t &remaining)
+	{
+		if (slot > _count || remaining == 0)
+			return;
+
+		Unfill(2 * slot, remaining);
+
+		if (remaining > 0)
+		{
+			_slots[slot].~type();
+			remaining--;
+		}
+
+		Unfill(2 * slot + 1, remaining);
+	}
+
+
+	void Destroy()
+	{
+		for (size_t slot = 1; slot <= _count; slot++)
+			_slots[slot].~type();
+
+		AlignedFree(_slots);
+		_slots = NULL;
+		_count = 0;
+	}
+
+
+	size_t LowerBoundSlot(const type &value) const
+	{
+		return Layout::LowerBoundSlot(_slots, _count, value);
+	}
+
+public:
+	FrozenTree() :
+		_slots(NULL),
+		_count(0)
+	{}
+
+	// Copies the count items starting at first, which must be sorted.
+	template <typename Iterator>
+	FrozenTree(Iterator first, size_t count) :
+		_slots(NULL),
+		_count(0)
+	{
+		_slots = static_cast<type *>(AlignedAllocate((count + 1) * sizeof(type)));
+		_count = count;
+
+		size_t built = 0;
+		try
+		{
+			Fill(1, first, built);
+		}
+		catch (...)
+		{
+			Unfill(1, built);
+			AlignedFree(_slots);
+			_slots = NULL;
+			_count = 0;
+			throw;
+		}
+	}
+
+	FrozenTree(FrozenTree &&other) :
+		_slots(other._slots),
+		_count(other._count)
+	{
+		other._slots = NULL;
+		other._count = 0;
+	}
+
+	FrozenTree &operator=(FrozenTree &&other)
+	{
+		if (this != &other)
+		{
+			Destroy();
+			std::swap(_slots, other._slots);
+			std::swap(_count, other._count);
+		}
+
+		return *this;
+	}
+
+	~FrozenTree()
+	{
+		Destroy();
+	}
+
+
+	// Returns the number of items.
+	int Count() const
+	{
+		return (int)_count;
+	}
+
+
+	// Returns true if value is one of the items.
+	bool Contains(const type &value) const
+	{
+		size_t slot = LowerBoundSlot(value);
+		return slot != 0 && !(value < _slots[slot]);
+	}
+
+
+	// Returns the smallest item that is not less than value, or NULL if every
+	// item is less than value.
+	const type *LowerBound(const type &value) const
+	{
+		size_t slot = LowerBoundSlot(value);
+		return slot == 0 ? NULL : &_slots[slot];
+	}
+
+
+	// Calls visit(item) on every item that is at least low and less than
+	// high, smallest first.
+	template <typename Visitor>
+	void VisitRange(const type &low, const type &high, Visitor visit) const
+	{
+		Layout::VisitRange(_slots, _count, low, high, visit);
+	}
+
+
+	// Writes the items to path in the TreeFile format, ready for MappedTree
+	// to open.  type must be trivially copyable, since the bytes are written
+	// as they are.  Throws if the file can't be written.
+	void Save(const char *path) const
+	{
+		TreeFile::Header header = TreeFile::MakeHeader<type>(_count);
+		if (_count != 0)
+			header.Checksum = TreeFile::Checksum(_slots + 1, _count * sizeof(type));
+
+		FILE *file = fopen(path, "wb");
+		if (file == NULL)
+			throw std::runtime_error("FrozenTree::Save: can't create the file.");
+
+		// Slot 0 goes out too (as zeros), so the file lines up with the
+		// slot numbers.
+		char zeros[sizeof(type)] = {};
+		bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(zeros, sizeof(type), 1, file) == 1;
+		if (written && _count != 0)
+			written = fwrite(_slots + 1, sizeof(type), _count, file) == _count;
+
+		if (fclose(file) != 0 || !written)
+		{
+			remove(path);
+			throw std::runtime_error("FrozenTree::Save: can't write the file.");
+		}
+	}
+};
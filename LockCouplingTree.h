@@ -0,0 +1,275 @@
+#pragma once
+
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+
+
+
+template <typename type>
+struct LockCouplingTreeNode
+{
+public:
+	type Data;
+	LockCouplingTreeNode *Left;
+	LockCouplingTreeNode *Right;
+	std::mutex Lock;
+
+	template <typename... Args>
+	explicit LockCouplingTreeNode(Args&&... args) :
+		Data(std::forward<Args>(args)...),
+		Left(NULL),
+		Right(NULL)
+	{}
+};
+
+
+// A binary search tree that many threads can Add to, Remove from and search
+// at the same time.  Every node has its own lock, and every operation walks
+// down hand over hand: it locks a child before letting go of the parent.
+// Threads working in different parts of the tree therefore only meet on the
+// first few levels, and since nobody can get at a node without holding its
+// parent, a node can be freed as soon as it is unlinked.
+//
+// Removing a node with two children moves the in-order successor's item into
+// it, so type must be move assignable.  Count() is exact: it changes with
+// each successful Add or Remove.
+template <typename type>
+class LockCouplingTree
+{
+private:
+	typedef LockCouplingTreeNode<type> Node;
+
+	// _rootLock guards _root the way a node's lock guards its child links.
+	Node *_root;
+	std::mutex _rootLock;
+	std::atomic<int> _count;
+
+	LockCouplingTree(const LockCouplingTree &);
+	LockCouplingTree &operator=(const LockCouplingTree &);
+
+
+	// Walks down to value holding at most two locks at a time.  On return the
+	// caller holds parentLock (the lock that guards *link) and, if *link is
+	// not NULL, (*link)->Lock as well.  *link is value's node, or the empty
+	// spot where it belongs.
+	Node **Descend(const type &value, std::mutex *&parentLock)
+	{
+		parentLock = &_rootLock;
+		parentLock->lock();
+
+		Node **link = &_root;
+		if (*link == NULL)
+			return link;
+		(*link)->Lock.lock();
+
+		while (true)
+		{
+			Node *node = *link;
+			Node **next;
+
+			if (value < node->Data)
+				next = &node->Left;
+			else if (node->Data < value)
+				next = &node->Right;
+			else
+				return link;
+
+			if (*next != NULL)
+				(*next)->Lock.lock();
+			parentLock->unlock();
+
+			parentLock = &node->Lock;
+			link = next;
+
+			if (*link == NULL)
+				return link;
+		}
+	}
+
+
+	template <typename Item>
+	void Insert(Item &&newItem)
+	{
+		std::mutex *parentLock;
+		Node **link = Descend(newItem, parentLock);
+
+		if (*link != NULL)
+		{
+			(*link)->Lock.unlock();
+			parentLock->unlock();
+			throw std::invalid_argument("LockCouplingTree::Add: the item is already in the tree.");
+		}
+
+		try
+		{
+			*link = new Node(std::forward<Item>(newItem));
+		}
+		catch (...)
+		{
+			parentLock->unlock();
+			throw;
+		}
+
+		_count++;
+		parentLock->unlock();
+	}
+
+
+	// Frees a subtree no other thread can reach any more.  Each node is locked
+	// once before it goes, which waits out any thread that got into the
+	// subtree earlier and is still at work below.  Returns the number of
+	// nodes freed.
+	static int DestroySubtree(Node *node)
+	{
+		std::vector<Node *> stack;
+		int freed = 0;
+
+		if (node != NULL)
+			stack.push_back(node);
+
+		while (!stack.empty())
+		{
+			node = stack.back();
+			stack.pop_back();
+
+			node->Lock.lock();
+			if (node->Left != NULL)
+				stack.push_back(node->Left);
+			if (node->Right != NULL)
+				stack.push_back(node->Right);
+			node->Lock.unlock();
+
+			delete node;
+			freed++;
+		}
+
+		return freed;
+	}
+
+public:
+	LockCouplingTree() :
+		_root(NULL),
+		_count(0)
+	{}
+
+	// No other thread may still be using the tree.
+	~LockCouplingTree()
+	{
+		DestroySubtree(_root);
+	}
+
+
+	// Adds a new item to the tree.  Throws if the item is already there.
+	void Add(const type &newItem)
+	{
+		Insert(newItem);
+	}
+
+	void Add(type &&newItem)
+	{
+		Insert(std::move(newItem));
+	}
+
+
+	// Removes an item from the tree.  Throws if the item is not there.
+	void Remove(const type &value)
+	{
+		std::mutex *parentLock;
+		Node **link = Descend(value, parentLock);
+		Node *node = *link;
+
+		if (node == NULL)
+		{
+			parentLock->unlock();
+			throw std::out_of_range("LockCouplingTree::Remove: the item is not in the tree.");
+		}
+
+		if (node->Left == NULL || node->Right == NULL)
+		{
+			// Holding the parent means no other thread can be on its way to
+			// node, and holding node means none is still on it.
+			*link = node->Left != NULL ? node->Left : node->Right;
+			node->Lock.unlock();
+			parentLock->unlock();
+
+			delete node;
+			_count--;
+			return;
+		}
+
+		// Two children.  Nobody new can get below node while we hold it, so
+		// walk hand over hand down to the smallest item on the right, move it
+		// up into node and unlink its old node.
+		parentLock->unlock();
+
+		std::mutex *successorParentLock = NULL;
+		Node **successorLink = &node->Right;
+		Node *successor = *successorLink;
+		successor->Lock.lock();
+
+		while (successor->Left != NULL)
+		{
+			Node *next = successor->Left;
+			next->Lock.lock();
+			if (successorParentLock != NULL)
+				successorParentLock->unlock();
+
+			successorParentLock = &successor->Lock;
+			successorLink = &successor->Left;
+			successor = next;
+		}
+
+		node->Data = std::move(successor->Data);
+		*successorLink = successor->Right;
+
+		successor->Lock.unlock();
+		if (successorParentLock != NULL)
+			successorParentLock->unlock();
+		node->Lock.unlock();
+
+		delete successor;
+		_count--;
+	}
+
+
+	// Returns the number of items in the tree.
+	int Count()
+	{
+		return _count;
+	}
+
+
+	// Returns true if the item is in the tree.
+	bool Contains(const type &value)
+	{
+		std::mutex *parentLock;
+		Node **link = Descend(value, parentLock);
+		bool found = *link != NULL;
+
+		if (found)
+			(*link)->Lock.unlock();
+		parentLock->unlock();
+
+		return found;
+	}
+
+
+	// Deletes every item in the tree.  Operations that started before Clear
+	// finish first; ones that start after it see an empty tree.
+	void Clear()
+	{
+		_rootLock.lock();
+		Node *oldRoot = _root;
+		_root = NULL;
+
+		// Keep new operations out until the old nodes are gone, so that the
+		// count only ever reflects items that are really in the tree.
+		_count -= DestroySubtree(oldRoot);
+		_rootLock.unlock();
+	}
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <utility>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TreeFile.h"
+#include "FrozenTree.h"
+
+
+
+
+// A read-only view of a file written by FrozenTree::Save (or
+// BinaryTree::Save).  Open() maps the file into memory and checks its header,
+// and that is all: the items are searched right where they sit in the
+// mapping, so opening takes the same time however many items there are, and
+// pages are only read in from disk as searches touch them.
+//
+// Open() does not read the items, so it can't tell if they were damaged
+// after they were written; call VerifyChecksum() for that, at the cost of
+// reading the whole file.
+template <typename type>
+class MappedTree
+{
+private:
+	typedef EytzingerLayout<type> Layout;
+
+	void *_mapping;
+	size_t _mappingSize;
+	const type *_slots;
+	size_t _count;
+	uint64_t _checksum;
+
+	MappedTree(const MappedTree &);
+	MappedTree &operator=(const MappedTree &);
+
+public:
+	MappedTree() :
+		_mapping(NULL),
+		_mappingSize(0),
+		_slots(NULL),
+		_count(0),
+		_checksum(0)
+	{}
+
+	// Opens path.  See Open.
+	explicit MappedTree(const char *path) :
+		_mapping(NULL),
+		_mappingSize(0),
+		_slots(NULL),
+		_count(0),
+		_checksum(0)
+	{
+		Open(path);
+	}
+
+	MappedTree(MappedTree &&other) :
+		_mapping(other._mapping),
+		_mappingSize(other._mappingSize),
+		_slots(other._slots),
+		_count(other._count),
+		_checksum(other._checksum)
+	{
+		other._mapping = NULL;
+		other._mappingSize = 0;
+		other._slots = NULL;
+		other._count = 0;
+	}
+
+	~MappedTree()
+	{
+		Close();
+	}
+
+
+	// Maps the tree file at path, closing whatever was open before.  Throws
+	// if the file can't be mapped or isn't a tree file of this type.
+	void Open(const char *path)
+	{
+		Close();
+
+		int file = open(path, O_RDONLY);
+		if (file < 0)
+			throw std::runtime_error("MappedTree::Open: can't open the file.");
+
+		struct stat info;
+		if (fstat(file, &info) != 0 || (uint64_t)info.st_size < sizeof(TreeFile::Header))
+		{
+			close(file);
+			throw std::runtime_error("MappedTree::Open: the file is too short to be a tree file.");
+		}
+
+		size_t size = (size_t)info.st_size;
+		void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+		close(file);
+
+		if (mapping == MAP_FAILED)
+			throw std::runtime_error("MappedTree::Open: can't map the file.");
+
+		const TreeFile::Header *header = static_cast<const TreeFile::Header *>(mapping);
+		try
+		{
+			TreeFile::CheckHeader<type>(*header, size);
+		}
+		catch (...)
+		{
+			munmap(mapping, size);
+			throw;
+		}
+
+		_mapping = mapping;
+		_mappingSize = size;
+		_slots = reinterpret_cast<const type *>(static_cast<const char *>(mapping) + header->ItemsOffset);
+		_count = (size_t)header->Count;
+		_checksum = header->Checksum;
+	}
+
+
+	// Unmaps the file.  The view is empty afterwards.
+	void Close()
+	{
+		if (_mapping != NULL)
+			munmap(_mapping, _mappingSize);
+
+		_mapping = NULL;
+		_mappingSize = 0;
+		_slots = NULL;
+		_count = 0;
+		_checksum = 0;
+	}
+
+
+	// Reads every item and returns true if they still match the checksum
+	// saved in the header.
+	bool VerifyChecksum() const
+	{
+		if (_count == 0)
+			return true;
+
+		return TreeFile::Checksum(_slots + 1, _count * sizeof(type)) == _checksum;
+	}
+
+
+	// Returns the number of items.
+	int Count() const
+	{
+		return (int)_count;
+	}
+
+
+	// Returns true if value is one of the items.
+	bool Contains(const type &value) const
+	{
+		size_t slot = Layout::LowerBoundSlot(_slots, _count, value);
+		return slot != 0 && !(value < _slots[slot]);
+	}
+
+
+	// Returns the smallest item that is not less than value, or NULL if every
+	// item is less than value.  The pointer is into the mapping, so it is
+	// good until the file is closed.
+	const type *LowerBound(const type &value) const
+	{
+		size_t slot = Layout::LowerBoundSlot(_slots, _count, value);
+		return slot == 0 ? NULL : &_slots[slot];
+	}
+
+
+	// Calls visit(item) on every item that is at least low and less than
+	// high, smallest first.
+	template <typename Visitor>
+	void VisitRange(const type &low, const type &high, Visitor visit) const
+	{
+		Layout::VisitRange(_slots, _count, low, high, visit);
+	}
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <stdlib.h>
+#include <new>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#include "BinaryTreeNode.h"
+
+
+
+
+// Node allocators are handed to BinaryTree as its Allocator template
+// parameter.  Each one must provide:
+//
+//     template <typename... Args>
+//     BinaryTreeNode<type> *Create(Args&&... args);   // args build the item
+//     void Destroy(BinaryTreeNode<type> *node);
+//     void Reset();                       // called by Clear() once every node is gone
+//     void Adopt(Allocator &other);       // takes over every node other handed out
+//     static const bool ReleasesInBulk;   // true if Reset() frees all node memory at once
+//     static const bool NodesMoveFreely;  // true if any allocator can Destroy any node
+
+
+
+
+// One heap allocation per node.  This is the default.
+template <typename type>
+class HeapNodeAllocator
+{
+public:
+	static const bool ReleasesInBulk = false;
+	static const bool NodesMoveFreely = true;
+
+	template <typename... Args>
+	BinaryTreeNode<type> *Create(Args&&... args)
+	{
+		return new BinaryTreeNode<type>(std::forward<Args>(args)...);
+	}
+
+	void Destroy(BinaryTreeNode<type> *node)
+	{
+		delete node;
+	}
+
+	void Reset()
+	{
+	}
+
+	void Adopt(HeapNodeAllocator &other)
+	{
+	}
+};
+
+
+// Carves nodes out of large slabs so they sit next to each other in memory
+// and most Adds cost a pointer bump.  Removed nodes go on a free list and are
+// handed out again by the next Create.  Reset() gives every slab back at
+// once, so Clear() on a tree of trivially destructible items doesn't even
+// have to visit the nodes.
+template <typename type>
+class PoolNodeAllocator
+{
+private:
+	typedef BinaryTreeNode<type> Node;
+
+	union Slot
+	{
+		Slot *Next;
+		typename std::aligned_storage<sizeof(Node), std::alignment_of<Node>::value>::type Storage;
+	};
+
+	static const size_t FirstSlabSize = 32;
+	static const size_t MaxSlabSize = 4096;
+
+	std::vector<Slot *> _slabs;
+	Slot *_bump;
+	Slot *_bumpEnd;
+	Slot *_free;
+	size_t _nextSlabSize;
+
+	PoolNodeAllocator(const PoolNodeAllocator &);
+	PoolNodeAllocator &operator=(const PoolNodeAllocator &);
+
+
+	Slot *TakeSlot()
+	{
+		if (_free != NULL)
+		{
+			Slot *slot = _free;
+			_free = slot->Next;
+			return slot;
+		}
+
+		if (_bump == _bumpEnd)
+		{
+			Slot *slab = new Slot[_nextSlabSize];
+			_slabs.push_back(slab);
+			_bump = slab;
+			_bumpEnd = slab + _nextSlabSize;
+
+			if (_nextSlabSize < MaxSlabSize)
+				_nextSlabSize *= 2;
+		}
+
+		return _bump++;
+	}
+
+
+	void GiveSlot(Slot *slot)
+	{
+		slot->Next = _free;
+		_free = slot;
+	}
+
+public:
+	static const bool ReleasesInBulk = true;
+	static const bool NodesMoveFreely = false;
+
+	PoolNodeAllocator() :
+		_bump(NULL),
+		_bumpEnd(NULL),
+		_free(NULL),
+		_nextSlabSize(FirstSlabSize)
+	{}
+
+	~PoolNodeAllocator()
+	{
+		Reset();
+	}
+
+
+	template <typename... Args>
+	BinaryTreeNode<type> *Create(Args&&... args)
+	{
+		Slot *slot = TakeSlot();
+
+		try
+		{
+			return new (&slot->Storage) Node(std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			GiveSlot(slot);
+			throw;
+		}
+	}
+
+
+	void Destroy(BinaryTreeNode<type> *node)
+	{
+		node->~Node();
+		GiveSlot(reinterpret_cast<Slot *>(node));
+	}
+
+
+	// Frees every slab.  Any node still handed out is gone after this, so the
+	// owner must have destroyed (or not need to destroy) them first.
+	void Reset()
+	{
+		for (size_t i = 0; i < _slabs.size(); i++)
+			delete[] _slabs[i];
+
+		_slabs.clear();
+		_bump = NULL;
+		_bumpEnd = NULL;
+		_free = NULL;
+		_nextSlabSize = FirstSlabSize;
+	}
+
+
+	// Takes over all of other's slabs, so the nodes it handed out can be
+	// destroyed through this allocator from now on.  other is left empty.
+	void Adopt(PoolNodeAllocator &other)
+	{
+		if (&other == this)
+			return;
+
+		_slabs.reserve(_slabs.size() + other._slabs.size());
+		_slabs.insert(_slabs.end(), other._slabs.begin(), other._slabs.end());
+
+		while (other._free != NULL)
+		{
+			Slot *slot = other._free;
+			other._free = slot->Next;
+			GiveSlot(slot);
+		}
+
+		// The rest of other's current slab is still unused.
+		while (other._bump != other._bumpEnd)
+			GiveSlot(other._bump++);
+
+		other._slabs.clear();
+		other.Reset();
+	}
+};
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <stdlib.h>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+
+
+
+template <typename type>
+struct PersistentTreeNode
+{
+public:
+	const type Data;
+	PersistentTreeNode *const Left;
+	PersistentTreeNode *const Right;
+	const int Height;
+
+	// How many trees and parent nodes point here.  Versions on different
+	// threads can share a node, so this is atomic.
+	mutable std::atomic<int> References;
+
+	PersistentTreeNode(PersistentTreeNode *left, const type &data, PersistentTreeNode *right, int height) :
+		Data(data),
+		Left(left),
+		Right(right),
+		Height(height),
+		References(1)
+	{}
+};
+
+
+// An AVL tree whose versions never change.  Add and Remove leave the tree
+// they are called on alone and return a new version instead, which copies
+// only the O(log n) nodes on the path to the change (plus at most two more
+// for a rotation) and shares every other node with the old version.  A
+// reader that holds on to a version therefore sees the same items for as
+// long as it likes, while writers carry on making new ones.
+//
+// Nodes are reference counted and freed as soon as no version can reach
+// them.  Copying a version is O(1).  Different threads can use different
+// version objects freely, even ones that share nodes; a single version
+// object that one thread assigns to while another copies it needs a lock,
+// like any other variable.
+//
+// BinaryTree's nodes have Parent links, which a node shared between versions
+// can't have, so this is a separate class with its own nodes rather than a
+// mode of BinaryTree.  Items are copied into the new path, so type must be
+// copy constructible.
+template <typename type>
+class PersistentTree
+{
+private:
+	typedef PersistentTreeNode<type> Node;
+
+	Node *_root;
+	int _count;
+
+	PersistentTree(Node *root, int count) :
+		_root(root),
+		_count(count)
+	{}
+
+
+	static int HeightOf(const Node *node)
+	{
+		return node == NULL ? 0 : node->Height;
+	}
+
+	static Node *Acquire(Node *node)
+	{
+		if (node != NULL)
+			node->References.fetch_add(1, std::memory_order_relaxed);
+
+		return node;
+	}
+
+	// Drops one reference, and frees every node that was only being kept
+	// alive by it.
+	static void Release(Node *node)
+	{
+		std::vector<Node *> dead;
+
+		if (node != NULL && node->References.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			dead.push_back(node);
+
+		while (!dead.empty())
+		{
+			node = dead.back();
+			dead.pop_back();
+
+			if (node->Left != NULL && node->Left->References.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				dead.push_back(node->Left);
+			if (node->Right != NULL && node->Right->References.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				dead.push_back(node->Right);
+
+			delete node;
+		}
+	}
+
+
+	// Returns a new node holding data over left and right, which it takes a
+	// reference to.  Like every function below that returns a node, the
+	// caller owns one reference to the result.
+	static Node *Create(Node *left, const type &data, Node *right)
+	{
+		int leftHeight = HeightOf(left);
+		int rightHeight = HeightOf(right);
+
+		Node *node = new Node(left, data, right, (leftHeight > rightHeight ? leftHeight : rightHeight) + 1);
+		Acquire(left);
+		Acquire(right);
+
+		return node;
+	}
+
+	// Create(Create(left, data, rightLeft), rightData, rightRight).
+	static Node *CreatePair(Node *left, const type &data, Node *rightLeft, const type &rightData, Node *rightRight)
+	{
+		Node *inner = Create(left, data, rightLeft);
+
+		try
+		{
+			Node *outer = Create(inner, rightData, rightRight);
+			Release(inner);
+			return outer;
+		}
+		catch (...)
+		{
+			Release(inner);
+			throw;
+		}
+	}
+
+	// Create(leftLeft, leftData, Create(leftRight, data, right)).
+	static Node *CreatePairRight(Node *leftLeft, const type &leftData, Node *leftRight, const type &data, Node *right)
+	{
+		Node *inner = Create(leftRight, data, right);
+
+		try
+		{
+			Node *outer = Create(leftLeft, leftData, inner);
+			Release(inner);
+			return outer;
+		}
+		catch (...)
+		{
+			Release(inner);
+			throw;
+		}
+	}
+
+
+	// Same as Create, but fixes things up with a rotation if left and right
+	// differ in height by two.  Only the nodes that change shape are copied.
+	static Node *Balance(Node *left, const type &data, Node *right)
+	{
+		if (HeightOf(left) > HeightOf(right) + 1)
+		{
+			if (HeightOf(left->Left) >= HeightOf(left->Right))
+				return CreatePairRight(left->Left, left->Data, left->Right, data, right);
+
+			// Double rotation: left's right child becomes the top.
+			Node *pivot = left->Right;
+			Node *newLeft = Create(left->Left, left->Data, pivot->Left);
+			try
+			{
+				Node *node = CreatePairRight(newLeft, pivot->Data, pivot->Right, data, right);
+				Release(newLeft);
+				return node;
+			}
+			catch (...)
+			{
+				Release(newLeft);
+				throw;
+			}
+		}
+
+		if (HeightOf(right) > HeightOf(left) + 1)
+		{
+			if (HeightOf(right->Right) >= HeightOf(right->Left))
+				return CreatePair(left, data, right->Left, right->Data, right->Right);
+
+			// Double rotation: right's left child becomes the top.
+			Node *pivot = right->Left;
+			Node *newRight = Create(pivot->Right, right->Data, right->Right);
+			try
+			{
+				Node *node = CreatePair(left, data, pivot->Left, pivot->Data, newRight);
+				Release(newRight);
+				return node;
+			}
+			catch (...)
+			{
+				Release(newRight);
+				throw;
+			}
+		}
+
+		return Create(left, data, right);
+	}
+
+
+	// Balance(left, data, right), then lets go of the caller's reference to
+	// whichever side was just rebuilt.
+	static Node *Rebuild(Node *left, const type &data, Node *right, Node *rebuilt)
+	{
+		try
+		{
+			Node *node = Balance(left, data, right);
+			Release(rebuilt);
+			return node;
+		}
+		catch (...)
+		{
+			Release(rebuilt);
+			throw;
+		}
+	}
+
+
+	// Returns a copy of the path to where newItem goes, with newItem added.
+	// newItem must not already be in the tree.
+	static Node *Insert(Node *node, const type &newItem)
+	{
+		if (node == NULL)
+			return Create(NULL, newItem, NULL);
+
+		if (newItem < node->Data)
+		{
+			Node *left = Insert(node->Left, newItem);
+			return Rebuild(left, node->Data, node->Right, left);
+		}
+
+		Node *right = Insert(node->Right, newItem);
+		return Rebuild(node->Left, node->Data, right, right);
+	}
+
+
+	// Returns a copy of the path to node's smallest item without that item.
+	static Node *EraseSmallest(Node *node)
+	{
+		if (node->Left == NULL)
+			return Acquire(node->Right);
+
+		Node *left = EraseSmallest(node->Left);
+		return Rebuild(left, node->Data, node->Right, left);
+	}
+
+
+	// Returns a copy of the path to value with value taken out.  value must
+	// be in the tree.
+	static Node *Erase(Node *node, const type &value)
+	{
+		if (value < node->Data)
+		{
+			Node *left = Erase(node->Left, value);
+			return Rebuild(left, node->Data, node->Right, left);
+		}
+
+		if (node->Data < value)
+		{
+			Node *right = Erase(node->Right, value);
+			return Rebuild(node->Left, node->Data, right, right);
+		}
+
+		if (node->Left == NULL)
+			return Acquire(node->Right);
+		if (node->Right == NULL)
+			return Acquire(node->Left);
+
+		// Two children: the smallest item on the right takes node's place.
+		const Node *successor = node->Right;
+		while (successor->Left != NULL)
+			successor = successor->Left;
+
+		Node *right = EraseSmallest(node->Right);
+		return Rebuild(node->Left, successor->Data, right, right);
+	}
+
+public:
+	// An empty tree.
+	PersistentTree() :
+		_root(NULL),
+		_count(0)
+	{}
+
+	// Versions are cheap to copy: they just share the root.
+	PersistentTree(const PersistentTree &other) :
+		_root(Acquire(other._root)),
+		_count(other._count)
+	{}
+
+	PersistentTree(PersistentTree &&other) :
+		_root(other._root),
+		_count(other._count)
+	{
+		other._root = NULL;
+		other._count = 0;
+	}
+
+	PersistentTree &operator=(PersistentTree other)
+	{
+		std::swap(_root, other._root);
+		std::swap(_count, other._count);
+		return *this;
+	}
+
+	~PersistentTree()
+	{
+		Release(_root);
+	}
+
+
+	// Returns a new version with newItem added.  Throws if the item is
+	// already in the tree.
+	PersistentTree Add(const type &newItem) const
+	{
+		if (Contains(newItem))
+			throw std::invalid_argument("PersistentTree::Add: the item is already in the tree.");
+
+		return PersistentTree(Insert(_root, newItem), _count + 1);
+	}
+
+
+	// Returns a new version with value taken out.  Throws if the item is not
+	// in the tree.
+	PersistentTree Remove(const type &value) const
+	{
+		if (!Contains(value))
+			throw std::out_of_range("PersistentTree::Remove: the item is not in the tree.");
+
+		return PersistentTree(Erase(_root, value), _count - 1);
+	}
+
+
+	// Returns the number of items in this version.
+	int Count() const
+	{
+		return _count;
+	}
+
+
+	// Returns true if the item is in this version.
+	bool Contains(const type &value) const
+	{
+		const Node *node = _root;
+
+		while (node != NULL)
+		{
+			if (value < node->Data)
+				node = node->Left;
+			else if (node->Data < value)
+				node = node->Right;
+			else
+				return true;
+		}
+
+		return false;
+	}
+
+
+	// Calls visit(item) on every item in this version that is at least low
+	// and less than high, smallest first.
+	template <typename Visitor>
+	void VisitRange(const type &low, const type &high, Visitor visit) const
+	{
+		std::vector<const Node *> stack;
+		const Node *node = _root;
+
+		while (node != NULL || !stack.empty())
+		{
+			// Subtrees entirely below low are skipped on the way down.
+			while (node != NULL)
+			{
+				if (node->Data < low)
+					node = node->Right;
+				else
+				{
+					stack.push_back(node);
+					node = node->Left;
+				}
+			}
+
+			if (stack.empty())
+				return;
+
+			node = stack.back();
+			stack.pop_back();
+
+			if (!(node->Data < high))
+				return;
+
+			visit(node->Data);
+			node = node->Right;
+		}
+	}
+
+
+	// Calls visit(item) on every item in this version, smallest first.
+	template <typename Visitor>
+	void VisitAll(Visitor visit) const
+	{
+		std::vector<const Node *> stack;
+		const Node *node = _root;
+
+		while (node != NULL || !stack.empty())
+		{
+			while (node != NULL)
+			{
+				stack.push_back(node);
+				node = node->Left;
+			}
+
+			node = stack.back();
+			stack.pop_back();
+
+			visit(node->Data);
+			node = node->Right;
+		}
+	}
+
+
+	// This method returns a pointer to the root node of this version.
+	const PersistentTreeNode<type> *GetRoot() const
+	{
+		return _root;
+	}
+};
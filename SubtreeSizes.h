@@ -0,0 +1,62 @@
+#pragma once
+
+#include "BinaryTreeNode.h"
+
+
+
+
+// The Sizes parameter of BinaryTree decides whether each node's Size (the
+// number of items in its subtree) is kept up to date.  That costs a walk back
+// up to the root on every Add and Remove, so it is off by default;
+// BinaryTree::Select and BinaryTree::Rank need it turned on.
+
+
+// Sizes are not kept.  Select and Rank won't compile.
+struct NoSubtreeSizes
+{
+	static const bool Enabled = false;
+
+	template <typename type>
+	static void AfterInsert(BinaryTreeNode<type> *node)
+	{
+	}
+
+	template <typename type>
+	static void AfterRemove(BinaryTreeNode<type> *parent)
+	{
+	}
+};
+
+
+// Sizes are kept, so the tree can find the k-th item, or count the items
+// below a value, in time proportional to its height.
+struct SubtreeSizes
+{
+	static const bool Enabled = true;
+
+	template <typename type>
+	static int SizeOf(const BinaryTreeNode<type> *node)
+	{
+		return node == NULL ? 0 : node->Size;
+	}
+
+
+	// The new leaf is already linked in; every node above it gained one.
+	template <typename type>
+	static void AfterInsert(BinaryTreeNode<type> *node)
+	{
+		node->Size = 1;
+		for (node = node->Parent; node != NULL; node = node->Parent)
+			node->Size++;
+	}
+
+
+	// parent is the lowest node whose subtree lost a node; it and every node
+	// above it lost one.
+	template <typename type>
+	static void AfterRemove(BinaryTreeNode<type> *parent)
+	{
+		for (; parent != NULL; parent = parent->Parent)
+			parent->Size--;
+	}
+};
@@ -1,5 +1,12 @@
 #include "TestCase.h"
-
+#include "AlignedMemory.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctime>
+#include <new>
+#include <atomic>
 #include <iostream>
 #include <string>
 
@@ -12,6 +19,96 @@
 using namespace std;
 int TestCase::_totalCount = 0;
 int TestCase::_totalPassing = 0;
+bool TestCase::_waitAtEnd = true;
+string TestCase::_jsonPath;
+vector<TestCase::Result> TestCase::_results;
+long TestCase::_stressOperations = 200000;
+unsigned TestCase::_seed = 1;
+
+
+// Every operator new and delete in the program is replaced here, so that
+// AssertAllocationsAtMost can count the news.  The forms all share one pair
+// of functions: if some went to the library's versions instead, a block
+// could be freed by a different allocator than the one that made it, which
+// sanitizers rightly refuse.  Aligned news are counted once, in the plain
+// operator new AlignedAllocate calls.
+static atomic<long> __allocationCount(0);
+
+static void *__Allocate(size_t size)
+{
+	__allocationCount.fetch_add(1, memory_order_relaxed);
+
+	if (size == 0)
+		size = 1;
+
+	while (true)
+	{
+		void *memory = malloc(size);
+		if (memory != NULL)
+			return memory;
+
+		new_handler handler = get_new_handler();
+		if (handler == NULL)
+			throw bad_alloc();
+		handler();
+	}
+}
+
+static void *__AllocateNoThrow(size_t size) noexcept
+{
+	try
+	{
+		return __Allocate(size);
+	}
+	catch (...)
+	{
+		return NULL;
+	}
+}
+
+void *operator new(size_t size) { return __Allocate(size); }
+void *operator new[](size_t size) { return __Allocate(size); }
+void *operator new(size_t size, const nothrow_t &) noexcept { return __AllocateNoThrow(size); }
+void *operator new[](size_t size, const nothrow_t &) noexcept { return __AllocateNoThrow(size); }
+
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete[](void *memory) noexcept { free(memory); }
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+void operator delete[](void *memory, size_t) noexcept { free(memory); }
+void operator delete(void *memory, const nothrow_t &) noexcept { free(memory); }
+void operator delete[](void *memory, const nothrow_t &) noexcept { free(memory); }
+
+#ifdef __cpp_aligned_new
+static void *__AllocateAligned(size_t size, align_val_t alignment)
+{
+	return AlignedAllocate(size, static_cast<size_t>(alignment));
+}
+
+static void *__AllocateAlignedNoThrow(size_t size, align_val_t alignment) noexcept
+{
+	try
+	{
+		return __AllocateAligned(size, alignment);
+	}
+	catch (...)
+	{
+		return NULL;
+	}
+}
+
+void *operator new(size_t size, align_val_t alignment) { return __AllocateAligned(size, alignment); }
+void *operator new[](size_t size, align_val_t alignment) { return __AllocateAligned(size, alignment); }
+void *operator new(size_t size, align_val_t alignment, const nothrow_t &) noexcept { return __AllocateAlignedNoThrow(size, alignment); }
+void *operator new[](size_t size, align_val_t alignment, const nothrow_t &) noexcept { return __AllocateAlignedNoThrow(size, alignment); }
+
+void operator delete(void *memory, align_val_t) noexcept { AlignedFree(memory); }
+void operator delete[](void *memory, align_val_t) noexcept { AlignedFree(memory); }
+void operator delete(void *memory, size_t, align_val_t) noexcept { AlignedFree(memory); }
+void operator delete[](void *memory, size_t, align_val_t) noexcept { AlignedFree(memory); }
+void operator delete(void *memory, align_val_t, const nothrow_t &) noexcept { AlignedFree(memory); }
+void operator delete[](void *memory, align_val_t, const nothrow_t &) noexcept { AlignedFree(memory); }
+#endif
+
 
 void __SetColor(int fore, int background = 0)
 {
@@ -47,7 +144,10 @@ void __WritePassFail(bool isPassing)
 }
 
 TestCase::TestCase(const char *msg):
-	_isPassing(true)
+	_isPassing(true),
+	_title(msg),
+	_wallStart(chrono::steady_clock::now()),
+	_cpuStart(CpuSeconds())
 {
 	_totalCount++;
 	__SetColor(0xF);
@@ -57,6 +157,14 @@ TestCase::TestCase(const char *msg):
 
 TestCase::~TestCase()
 {
+	Result result;
+	result.Title = _title;
+	result.Passed = _isPassing;
+	result.WallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - _wallStart).count();
+	result.CpuMs = (CpuSeconds() - _cpuStart) * 1000;
+	result.Failures = _failures;
+	_results.push_back(result);
+
     if (_isPassing)
     {
         _totalPassing++;
@@ -70,9 +178,23 @@ TestCase::~TestCase()
 	}
 	__SetColor(7);
 
+	cout << "  (" << result.WallMs << " ms wall, " << result.CpuMs << " ms CPU)";
     cout << endl << endl << endl;
 }
 
+
+void TestCase::Fail(const char *msg)
+{
+	_isPassing = false;
+	_failures.push_back(msg);
+}
+
+
+double TestCase::CpuSeconds()
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
 void TestCase::LogResult(bool passed, const char *msg)
 {
 	__WritePassFail(passed);
@@ -80,7 +202,7 @@ void TestCase::LogResult(bool passed, const char *msg)
 	cout << msg << endl;
 
 	if (!passed)
-		_isPassing = false;
+		Fail(msg);
 }
 
 void TestCase::Assert(bool condition, const char *msg)
@@ -90,7 +212,7 @@ void TestCase::Assert(bool condition, const char *msg)
     cout << "ASSERT: " << msg << endl;
 
     if (!condition)
-        _isPassing = false;
+        Fail(msg);
 }
 
 
@@ -102,7 +224,7 @@ void TestCase::AssertEquals(bool expected, bool actual, const char *msg)
 		cout << msg << "  Expected=" << expected << endl;
 	else
 	{
-		_isPassing = false;
+		Fail(msg);
 		cout << msg << "  Expected=" << expected << "  Actual=" << actual << endl;
 	}
 }
@@ -116,7 +238,7 @@ void TestCase::AssertEquals(int expected, int actual, const char *msg)
 		cout << msg << "  Expected=" << expected << endl;
 	else
 	{
-		_isPassing = false;
+		Fail(msg);
 		cout << msg << "  Expected=" << expected << "  Actual=" << actual << endl;
 	}
 }
@@ -131,7 +253,7 @@ void TestCase::AssertEquals(const string& expected, const string& actual, const
 		cout << msg << "  Expected=" << expected << endl;
 	else
 	{
-		_isPassing = false;
+		Fail(msg);
 		cout << msg << "  Expected=" << expected << "  Actual=" << actual << endl;
 	}
 }
@@ -146,6 +268,127 @@ void TestCase::LogException(std::exception ex)
 }
 
 
+// Prints a line that is neither a pass nor a failure, such as a measurement.
+void TestCase::LogInfo(const char *msg)
+{
+	cout << "    Info: " << msg << endl;
+}
+
+
+void TestCase::AssertFasterThan(double limitNs, double measuredNs, const char *msg)
+{
+	bool success = measuredNs <= limitNs;
+	__WritePassFail(success);
+
+	cout << msg << "  Limit=" << limitNs << "ns  Measured=" << measuredNs << "ns" << endl;
+
+	if (!success)
+		Fail(msg);
+}
+
+
+void TestCase::AssertAllocationsAtMost(long limit, long measured, const char *msg)
+{
+	bool success = measured <= limit;
+	__WritePassFail(success);
+
+	cout << msg << "  Limit=" << limit << "  Measured=" << measured << endl;
+
+	if (!success)
+		Fail(msg);
+}
+
+
+long TestCase::AllocationCount()
+{
+	return __allocationCount.load(memory_order_relaxed);
+}
+
+
+void TestCase::ParseArguments(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--no-wait") == 0)
+			_waitAtEnd = false;
+		else if (strncmp(argv[i], "--json=", 7) == 0)
+			_jsonPath = argv[i] + 7;
+		else if (strncmp(argv[i], "--stress-ops=", 13) == 0)
+			_stressOperations = strtol(argv[i] + 13, NULL, 10);
+		else if (strncmp(argv[i], "--seed=", 7) == 0)
+			_seed = (unsigned)strtoul(argv[i] + 7, NULL, 10);
+		else
+			cout << "Ignoring unknown option " << argv[i] << endl;
+	}
+}
+
+
+long TestCase::StressOperations()
+{
+	return _stressOperations;
+}
+
+
+unsigned TestCase::Seed()
+{
+	return _seed;
+}
+
+
+static void __WriteJsonString(FILE *file, const string &text)
+{
+	fputc('"', file);
+
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		unsigned char c = text[i];
+
+		if (c == '"' || c == '\\')
+			fprintf(file, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(file, "\\u%04x", c);
+		else
+			fputc(c, file);
+	}
+
+	fputc('"', file);
+}
+
+
+void TestCase::WriteJson()
+{
+	FILE *file = fopen(_jsonPath.c_str(), "w");
+	if (file == NULL)
+	{
+		cout << "Can't write " << _jsonPath << endl;
+		return;
+	}
+
+	fprintf(file, "{\n  \"passing\": %d,\n  \"failing\": %d,\n  \"tests\": [", _totalPassing, _totalCount - _totalPassing);
+
+	for (size_t i = 0; i < _results.size(); i++)
+	{
+		const Result &result = _results[i];
+
+		fprintf(file, "%s\n    {\"title\": ", i == 0 ? "" : ",");
+		__WriteJsonString(file, result.Title);
+		fprintf(file, ", \"passed\": %s, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"failures\": [", result.Passed ? "true" : "false", result.WallMs, result.CpuMs);
+
+		for (size_t f = 0; f < result.Failures.size(); f++)
+		{
+			if (f != 0)
+				fputs(", ", file);
+			__WriteJsonString(file, result.Failures[f]);
+		}
+
+		fputs("]}", file);
+	}
+
+	fputs("\n  ]\n}\n", file);
+	fclose(file);
+}
+
+
 void TestCase::PrintBanner(const char* msg)
 {
 	__SetColor(0xF);
@@ -175,8 +418,20 @@ void TestCase::PrintSummary()
     cout << "Your grade: " << 20.0 + (double)percentage * 0.80 << "%";
 
     cout << endl;
-    cout << "Press [Enter] to continue...";
-    std::cin.get();
+
+	if (!_jsonPath.empty())
+		WriteJson();
+
+	if (_waitAtEnd)
+	{
+		cout << "Press [Enter] to continue...";
+		std::cin.get();
+	}
+}
+
+int TestCase::FailingCount()
+{
+	return _totalCount - _totalPassing;
 }
 
 bool TestCase::IsPassing()
@@ -1,16 +1,56 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <chrono>
 
 #define RESULT_PASSED true
 #define RESULT_FAILED false
 
+// Command-line options understood by TestCase::ParseArguments:
+//
+//     --no-wait       don't wait for Enter after the summary, so the suite can
+//                     run unattended
+//     --json=PATH     also write every test's result and timing to PATH as JSON
+//     --stress-ops=N  how many random operations the stress tests run on each
+//                     tree (default 200000); raise it to test at production
+//                     sizes
+//     --seed=N        seed for the stress tests' random operations (default
+//                     1), to replay a failing run
+//
+// AssertAllocationsAtMost counts calls to the global operator new, in all
+// its forms, which TestCase.cpp replaces for the whole program.  The count
+// covers every thread, so keep other threads quiet while it runs.
 class TestCase
 {
 private:
+    struct Result
+    {
+        std::string Title;
+        bool Passed;
+        double WallMs;
+        double CpuMs;
+        std::vector<std::string> Failures;
+    };
+
     bool _isPassing;
+    std::string _title;
+    std::vector<std::string> _failures;
+    std::chrono::steady_clock::time_point _wallStart;
+    double _cpuStart;
+
     static int _totalCount;
     static int _totalPassing;
+    static bool _waitAtEnd;
+    static std::string _jsonPath;
+    static std::vector<Result> _results;
+    static long _stressOperations;
+    static unsigned _seed;
+
+    void Fail(const char *msg);
+
+    static double CpuSeconds();
+    static void WriteJson();
 
 public:
     TestCase(const char* title);
@@ -22,9 +62,45 @@ public:
 	void AssertEquals(int expected, int actual, const char *msg);
 	void AssertEquals(const std::string& expected, const std::string& actual, const char *msg);
 	void LogException(std::exception ex);
+	void LogInfo(const char *msg);
 	bool IsPassing();
 
+	// Fails unless measuredNs is no more than limitNs.
+	void AssertFasterThan(double limitNs, double measuredNs, const char *msg);
+
+	// Runs function once and fails unless it took no more than limitNs for
+	// each of its ops operations.
+	template <typename Function>
+	void AssertFasterThan(double limitNs, long ops, Function function, const char *msg)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		function();
+		double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+		AssertFasterThan(limitNs, ops > 0 ? elapsedNs / ops : elapsedNs, msg);
+	}
+
+	// Fails unless measured is no more than limit.
+	void AssertAllocationsAtMost(long limit, long measured, const char *msg);
+
+	// Runs function once and fails unless it called operator new no more
+	// than limit times.
+	template <typename Function>
+	void AssertAllocationsAtMost(long limit, Function function, const char *msg)
+	{
+		long before = AllocationCount();
+		function();
+		AssertAllocationsAtMost(limit, AllocationCount() - before, msg);
+	}
+
+	// How many times the global operator new has been called so far.
+	static long AllocationCount();
+
+	static void ParseArguments(int argc, char *argv[]);
+	static long StressOperations();
+	static unsigned Seed();
 	static void PrintBanner(const char* msg);
     static void PrintSummary();
+	static int FailingCount();
 };
 
@@ -0,0 +1,398 @@
+#pragma once
+
+#include "BinaryTreeNode.h"
+#include "SubtreeSizes.h"
+#include "TreeStats.h"
+
+
+
+
+// Rotations shared by the balancing policies.  Both keep the Parent links
+// intact and update root when the rotated node was the root of the tree.
+// They also carry the subtree sizes across, which is only meaningful when the
+// tree keeps them (see SubtreeSizes.h) and harmless when it doesn't.
+struct TreeRotation
+{
+	template <typename type>
+	static void UpdateSize(BinaryTreeNode<type> *node)
+	{
+		node->Size = 1 + SubtreeSizes::SizeOf(node->Left) + SubtreeSizes::SizeOf(node->Right);
+	}
+
+	// The pivot takes over node's whole subtree, so it inherits its size;
+	// node is left with what is still below it.
+	template <typename type>
+	static void RotateSizes(BinaryTreeNode<type> *node, BinaryTreeNode<type> *pivot)
+	{
+		pivot->Size = node->Size;
+		UpdateSize(node);
+	}
+
+
+	// Makes left and right middle's subtrees and returns middle, with no
+	// attempt at balancing.
+	template <typename type>
+	static BinaryTreeNode<type> *Attach(BinaryTreeNode<type> *left, BinaryTreeNode<type> *middle, BinaryTreeNode<type> *right)
+	{
+		middle->Parent = NULL;
+		middle->Left = left;
+		middle->Right = right;
+
+		if (left != NULL)
+			left->Parent = middle;
+		if (right != NULL)
+			right->Parent = middle;
+
+		UpdateSize(middle);
+		return middle;
+	}
+
+
+	template <typename type>
+	static void ReplaceChild(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *oldChild, BinaryTreeNode<type> *newChild)
+	{
+		BinaryTreeNode<type> *parent = oldChild->Parent;
+
+		if (parent == NULL)
+			root = newChild;
+		else if (parent->Left == oldChild)
+			parent->Left = newChild;
+		else
+			parent->Right = newChild;
+
+		if (newChild != NULL)
+			newChild->Parent = parent;
+	}
+
+
+	// Rotates node's right child up into node's place and returns it.
+	template <typename type>
+	static BinaryTreeNode<type> *RotateLeft(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node)
+	{
+		BinaryTreeNode<type> *pivot = node->Right;
+
+		node->Right = pivot->Left;
+		if (pivot->Left != NULL)
+			pivot->Left->Parent = node;
+
+		ReplaceChild(root, node, pivot);
+		pivot->Left = node;
+		node->Parent = pivot;
+		RotateSizes(node, pivot);
+
+		return pivot;
+	}
+
+
+	// Rotates node's left child up into node's place and returns it.
+	template <typename type>
+	static BinaryTreeNode<type> *RotateRight(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node)
+	{
+		BinaryTreeNode<type> *pivot = node->Left;
+
+		node->Left = pivot->Right;
+		if (pivot->Right != NULL)
+			pivot->Right->Parent = node;
+
+		ReplaceChild(root, node, pivot);
+		pivot->Right = node;
+		node->Parent = pivot;
+		RotateSizes(node, pivot);
+
+		return pivot;
+	}
+};
+
+
+// Plain binary search tree: nodes stay wherever Add puts them.  This is the
+// default so existing trees keep exactly the shape they always had.
+struct NoBalance
+{
+	template <typename type, typename Stats>
+	static void AfterInsert(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node, Stats &stats)
+	{
+	}
+
+	template <typename type, typename Stats>
+	static void AfterRemove(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *parent, Stats &stats)
+	{
+	}
+
+	// A search has ended at node: the item it found, or the last node it
+	// looked at if it found nothing.
+	template <typename type, typename Stats>
+	static void AfterAccess(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node, Stats &stats)
+	{
+	}
+
+
+	// Returns a tree holding left, then middle, then right.  Every item in
+	// left must be smaller than middle, and every item in right larger.
+	template <typename type>
+	static BinaryTreeNode<type> *Join(BinaryTreeNode<type> *left, BinaryTreeNode<type> *middle, BinaryTreeNode<type> *right)
+	{
+		return TreeRotation::Attach(left, middle, right);
+	}
+};
+
+
+// AVL tree: after every Add and Remove the heights of the two subtrees of
+// any node differ by at most one, so the tree height stays O(log n) even when
+// the items arrive in sorted order.
+struct AvlBalance
+{
+	template <typename type>
+	static int HeightOf(const BinaryTreeNode<type> *node)
+	{
+		return node == NULL ? 0 : node->Height;
+	}
+
+	template <typename type>
+	static void UpdateHeight(BinaryTreeNode<type> *node)
+	{
+		int left = HeightOf(node->Left);
+		int right = HeightOf(node->Right);
+
+		node->Height = (left > right ? left : right) + 1;
+	}
+
+	template <typename type>
+	static int BalanceFactor(const BinaryTreeNode<type> *node)
+	{
+		return HeightOf(node->Left) - HeightOf(node->Right);
+	}
+
+
+	// The new node is already linked in as a leaf; walk up from its parent.
+	template <typename type, typename Stats>
+	static void AfterInsert(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node, Stats &stats)
+	{
+		node->Height = 1;
+		Rebalance(root, node->Parent, stats);
+	}
+
+
+	// parent is the lowest node whose subtree lost a node (NULL if the tree
+	// root itself was removed and nothing was below it).
+	template <typename type, typename Stats>
+	static void AfterRemove(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *parent, Stats &stats)
+	{
+		Rebalance(root, parent, stats);
+	}
+
+	// Searches leave an AVL tree as it is.
+	template <typename type, typename Stats>
+	static void AfterAccess(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node, Stats &stats)
+	{
+	}
+
+
+	// Returns a tree holding left, then middle, then right.  Every item in
+	// left must be smaller than middle, and every item in right larger.  If
+	// one side is much taller, middle goes down its inner spine to where the
+	// heights match and the path back up is rebalanced, so this takes time
+	// proportional to the difference in height.
+	template <typename type>
+	static BinaryTreeNode<type> *Join(BinaryTreeNode<type> *left, BinaryTreeNode<type> *middle, BinaryTreeNode<type> *right)
+	{
+		int leftHeight = HeightOf(left);
+		int rightHeight = HeightOf(right);
+
+		if (left != NULL)
+			left->Parent = NULL;
+		if (right != NULL)
+			right->Parent = NULL;
+
+		if (leftHeight > rightHeight + 1)
+		{
+			BinaryTreeNode<type> *root = left;
+			BinaryTreeNode<type> *parent = NULL;
+			BinaryTreeNode<type> *spine = left;
+			while (HeightOf(spine) > rightHeight + 1)
+			{
+				parent = spine;
+				spine = spine->Right;
+			}
+
+			TreeRotation::Attach(spine, middle, right);
+			UpdateHeight(middle);
+			parent->Right = middle;
+			middle->Parent = parent;
+
+			for (BinaryTreeNode<type> *above = parent; above != NULL; above = above->Parent)
+				above->Size += 1 + SubtreeSizes::SizeOf(right);
+
+			Rebalance(root, parent);
+			return root;
+		}
+
+		if (rightHeight > leftHeight + 1)
+		{
+			BinaryTreeNode<type> *root = right;
+			BinaryTreeNode<type> *parent = NULL;
+			BinaryTreeNode<type> *spine = right;
+			while (HeightOf(spine) > leftHeight + 1)
+			{
+				parent = spine;
+				spine = spine->Left;
+			}
+
+			TreeRotation::Attach(left, middle, spine);
+			UpdateHeight(middle);
+			parent->Left = middle;
+			middle->Parent = parent;
+
+			for (BinaryTreeNode<type> *above = parent; above != NULL; above = above->Parent)
+				above->Size += 1 + SubtreeSizes::SizeOf(left);
+
+			Rebalance(root, parent);
+			return root;
+		}
+
+		TreeRotation::Attach(left, middle, right);
+		UpdateHeight(middle);
+		return middle;
+	}
+
+
+	template <typename type>
+	static void Rebalance(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node)
+	{
+		NoTreeStats stats;
+		Rebalance(root, node, stats);
+	}
+
+
+	// Restores the AVL invariant on the path from node up to the root.  Stops
+	// early once a subtree comes out with the same height it had before,
+	// since nothing above it can have changed.  Each rotation is reported to
+	// stats.
+	template <typename type, typename Stats>
+	static void Rebalance(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node, Stats &stats)
+	{
+		while (node != NULL)
+		{
+			int oldHeight = node->Height;
+			UpdateHeight(node);
+
+			int balance = BalanceFactor(node);
+			if (balance > 1)
+			{
+				if (BalanceFactor(node->Left) < 0)
+				{
+					TreeRotation::RotateLeft(root, node->Left);
+					UpdateHeight(node->Left->Left);
+					stats.Rotate();
+				}
+
+				node = TreeRotation::RotateRight(root, node);
+				stats.Rotate();
+				UpdateHeight(node->Right);
+				UpdateHeight(node->Left);
+				UpdateHeight(node);
+			}
+			else if (balance < -1)
+			{
+				if (BalanceFactor(node->Right) > 0)
+				{
+					TreeRotation::RotateRight(root, node->Right);
+					UpdateHeight(node->Right->Right);
+					stats.Rotate();
+				}
+
+				node = TreeRotation::RotateLeft(root, node);
+				stats.Rotate();
+				UpdateHeight(node->Left);
+				UpdateHeight(node->Right);
+				UpdateHeight(node);
+			}
+
+			if (node->Height == oldHeight)
+				return;
+
+			node = node->Parent;
+		}
+	}
+};
+
+
+// Splay tree: Add, Remove and Contains each finish by rotating the node they
+// reached up to the root, so items that are used often stay near the top.
+// One operation can still take O(n), but any m of them on a tree of n items
+// take O((m + n) log n) in all, and a hot set of k items costs about
+// O(log k) per access.  Only those three splay: const searches such as
+// LowerBound, Select and the iterators leave the tree alone, and so do
+// ContainsBatch and Split.  Heights aren't kept.
+struct SplayBalance
+{
+	template <typename type, typename Stats>
+	static void AfterInsert(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node, Stats &stats)
+	{
+		Splay(root, node, stats);
+	}
+
+	// Splaying the removed node's old parent pays for the walk down to it.
+	template <typename type, typename Stats>
+	static void AfterRemove(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *parent, Stats &stats)
+	{
+		if (parent != NULL)
+			Splay(root, parent, stats);
+	}
+
+	// Misses splay too, or searching for a deep missing item over and over
+	// would cost its full depth every time.
+	template <typename type, typename Stats>
+	static void AfterAccess(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node, Stats &stats)
+	{
+		if (node != NULL)
+			Splay(root, node, stats);
+	}
+
+
+	// Any join of two search trees is a valid splay tree; later accesses
+	// will even out whatever shape it has.
+	template <typename type>
+	static BinaryTreeNode<type> *Join(BinaryTreeNode<type> *left, BinaryTreeNode<type> *middle, BinaryTreeNode<type> *right)
+	{
+		return TreeRotation::Attach(left, middle, right);
+	}
+
+
+	// Rotates node over its parent.
+	template <typename type>
+	static void RotateUp(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node)
+	{
+		if (node->Parent->Left == node)
+			TreeRotation::RotateRight(root, node->Parent);
+		else
+			TreeRotation::RotateLeft(root, node->Parent);
+	}
+
+
+	// Moves node to the root two levels at a time.  When node and its parent
+	// are both left or both right children (zig-zig) the parent goes up
+	// first, which is what roughly halves the depth of every node on the
+	// path; otherwise (zig-zag) node goes up twice.  A lone final step
+	// (zig) is needed when node starts at an odd depth.
+	template <typename type, typename Stats>
+	static void Splay(BinaryTreeNode<type> *&root, BinaryTreeNode<type> *node, Stats &stats)
+	{
+		while (node->Parent != NULL)
+		{
+			BinaryTreeNode<type> *parent = node->Parent;
+			BinaryTreeNode<type> *grandparent = parent->Parent;
+
+			if (grandparent != NULL)
+			{
+				if ((grandparent->Left == parent) == (parent->Left == node))
+					RotateUp(root, parent);
+				else
+					RotateUp(root, node);
+				stats.Rotate();
+			}
+
+			RotateUp(root, node);
+			stats.Rotate();
+		}
+	}
+};
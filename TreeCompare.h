@@ -0,0 +1,31 @@
+#pragma once
+
+
+
+
+// The Compare parameter of BinaryTree orders the items, the way it does for
+// std::set: compare(a, b) is true if a belongs before b.  The default,
+// std::less<type>, uses the items' operator<.
+//
+// A comparator that declares an is_transparent type can also compare items
+// with keys of other types, and then Contains, Remove and Find take those
+// keys directly instead of building a temporary item to search for.  It
+// must order a key exactly as it orders the item the key stands for.
+//
+// Freeze, Save and LookupCache still use operator<, so they only go with
+// std::less and TransparentLess; BinaryTree refuses to compile otherwise.
+
+
+// Orders anything by operator<, between any two types that have one.  With
+// this, a tree of std::string can be searched with a const char * and no
+// string is built.
+struct TransparentLess
+{
+	typedef void is_transparent;
+
+	template <typename Left, typename Right>
+	bool operator()(const Left &left, const Right &right) const
+	{
+		return left < right;
+	}
+};
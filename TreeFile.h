@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdexcept>
+#include <type_traits>
+
+#include "AlignedMemory.h"
+
+
+
+
+// The on-disk format written by FrozenTree::Save and read by MappedTree.  It
+// holds no pointers: a 64-byte header, then the items in Eytzinger order
+// exactly as FrozenTree keeps them in memory, starting with the unused slot
+// 0.  A search finds its way by slot number alone, so the file can be
+// searched straight out of a memory mapping.
+//
+// The items are stored in the saving machine's byte order and layout, so a
+// file only opens on a machine (and build) with the same ones; the header
+// records enough to refuse anything else.
+struct TreeFile
+{
+	static const uint32_t CurrentVersion = 1;
+	static const uint32_t ByteOrderMark = 0x01020304;
+
+	struct Header
+	{
+		char Magic[8];
+		uint32_t Version;
+		uint32_t ByteOrder;
+		uint32_t ItemSize;
+		uint32_t ItemAlignment;
+		uint64_t Count;
+		uint64_t ItemsOffset;   // where slot 0 starts
+		uint64_t Checksum;      // of the bytes of slots 1..Count
+		char Reserved[16];
+	};
+
+	static_assert(sizeof(Header) == CacheLineSize, "TreeFile::Header should fill one cache line.");
+
+
+	static const char *Magic()
+	{
+		return "TREEFILE";
+	}
+
+
+	template <typename type>
+	static Header MakeHeader(size_t count)
+	{
+		static_assert(std::is_trivially_copyable<type>::value, "TreeFile items are saved byte for byte, so they must be trivially copyable.");
+		static_assert(std::alignment_of<type>::value <= CacheLineSize, "TreeFile items can't need more than cache-line alignment.");
+
+		Header header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.Magic, Magic(), sizeof(header.Magic));
+		header.Version = CurrentVersion;
+		header.ByteOrder = ByteOrderMark;
+		header.ItemSize = sizeof(type);
+		header.ItemAlignment = std::alignment_of<type>::value;
+		header.Count = count;
+		header.ItemsOffset = sizeof(Header);
+
+		return header;
+	}
+
+
+	// Throws unless header describes a file of fileSize bytes holding items
+	// of this type, saved by a compatible machine.
+	template <typename type>
+	static void CheckHeader(const Header &header, uint64_t fileSize)
+	{
+		if (memcmp(header.Magic, Magic(), sizeof(header.Magic)) != 0)
+			throw std::runtime_error("TreeFile: not a tree file.");
+		if (header.Version != CurrentVersion)
+			throw std::runtime_error("TreeFile: unsupported version.");
+		if (header.ByteOrder != ByteOrderMark)
+			throw std::runtime_error("TreeFile: saved with a different byte order.");
+		if (header.ItemSize != sizeof(type) || header.ItemAlignment != std::alignment_of<type>::value)
+			throw std::runtime_error("TreeFile: saved with a different item type.");
+		if (header.ItemsOffset % CacheLineSize != 0 || header.ItemsOffset < sizeof(Header) || header.ItemsOffset > fileSize)
+			throw std::runtime_error("TreeFile: bad item offset.");
+
+		// Count + 1 would wrap for a Count of 2^64 - 1, so compare the other way.
+		uint64_t slots = (fileSize - header.ItemsOffset) / sizeof(type);
+		if (slots * sizeof(type) != fileSize - header.ItemsOffset || slots < 1 || header.Count != slots - 1)
+			throw std::runtime_error("TreeFile: the file is the wrong size for its item count.");
+	}
+
+
+	// 64-bit FNV-1a of size bytes at data.
+	static uint64_t Checksum(const void *data, size_t size)
+	{
+		const unsigned char *bytes = static_cast<const unsigned char *>(data);
+		uint64_t hash = 14695981039346656037ULL;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+
+		return hash;
+	}
+};
@@ -1,54 +1,616 @@
 #pragma once
 #include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <utility>
 #include "BinaryTree.h"
+#include "BTree.h"
+#include "WorkStealingPool.h"
+
+
+// How TreeHelper walks the tree.  All three give exactly the same output.
+//
+//   TraverseRecursive  - one call per node; simple, but a degenerate tree can
+//                        overflow the call stack.
+//   TraverseIterative  - keeps its own stack on the heap, so depth is only
+//                        limited by memory.  This is the default.
+//   TraverseMorris     - O(1) extra space.  Temporarily threads Right links
+//                        through the tree and restores them before returning,
+//                        so nothing else may touch the tree during the call.
+enum TraversalMethod
+{
+	TraverseRecursive,
+	TraverseIterative,
+	TraverseMorris
+};
+
+
+// What TreeHelper::MeasureShape found out about a tree.
+struct TreeShape
+{
+	int Count;
+	int Height;                     // levels in the tree; 0 when empty
+	int MinimumHeight;              // the height of a perfectly balanced tree of Count items
+	double AverageDepth;            // mean depth of the items, the root being 1
+	std::vector<int> NodesPerLevel; // NodesPerLevel[0] is the root's level
+	int LeafCount;
+	int WorstImbalance;             // largest height difference between any node's subtrees
+};
+
 
 template <typename type>
 class TreeHelper
 {
-public:
-	TreeHelper() {}
-	~TreeHelper() {}
+private:
+	typedef BinaryTreeNode<type> Node;
+
+
+	// Lets the iterative walks write straight into a slice of a vector that
+	// has already been sized, instead of appending.
+	struct SliceWriter
+	{
+		type *Next;
+
+		void push_back(const type &item)
+		{
+			*Next++ = item;
+		}
+	};
 
-	void ToVectorInOrder(const BinaryTreeNode<type> *node, std::vector<type> &vector)
+
+	// Piece of a tree cut up for the parallel walks: either a whole subtree or
+	// just the one node where it was cut.
+	struct Piece
+	{
+		const Node *Root;
+		bool WholeSubtree;
+		size_t Size;
+	};
+
+
+	static size_t CountNodes(const Node *node)
+	{
+		std::vector<const Node *> stack;
+		size_t count = 0;
+
+		if (node != NULL)
+			stack.push_back(node);
+
+		while (!stack.empty())
+		{
+			node = stack.back();
+			stack.pop_back();
+			count++;
+
+			if (node->Left != NULL)
+				stack.push_back(node->Left);
+			if (node->Right != NULL)
+				stack.push_back(node->Right);
+		}
+
+		return count;
+	}
+
+
+	// Cuts the top levels of the tree into pieces, listed in the order the
+	// traversal will output them.  order is -1 for pre-order, 0 for in-order
+	// and 1 for post-order.
+	static void Cut(const Node *node, int order, int levels, std::vector<Piece> &pieces)
 	{
 		if (node == NULL)
 			return;
 
+		if (levels == 0)
+		{
+			Piece piece = { node, true, 0 };
+			pieces.push_back(piece);
+			return;
+		}
+
+		Piece self = { node, false, 1 };
+
+		if (order < 0)
+			pieces.push_back(self);
+		Cut(node->Left, order, levels - 1, pieces);
+		if (order == 0)
+			pieces.push_back(self);
+		Cut(node->Right, order, levels - 1, pieces);
+		if (order > 0)
+			pieces.push_back(self);
+	}
+
+
+	// Splits the tree into enough subtrees to keep every thread in pool busy,
+	// counts them in parallel to work out where each one's output starts,
+	// then has each fill its own slice of vector.
+	void ToVectorParallel(const Node *node, std::vector<type> &vector, int order, WorkStealingPool &pool)
+	{
+		int levels = 0;
+		while (((size_t)1 << levels) < pool.ThreadCount() * 8)
+			levels++;
+
+		std::vector<Piece> pieces;
+		Cut(node, order, levels, pieces);
+
+		pool.Run(pieces.size(), [&pieces](size_t i)
+		{
+			if (pieces[i].WholeSubtree)
+				pieces[i].Size = CountNodes(pieces[i].Root);
+		});
+
+		size_t first = vector.size();
+		std::vector<size_t> offsets(pieces.size());
+		size_t total = 0;
+		for (size_t i = 0; i < pieces.size(); i++)
+		{
+			offsets[i] = first + total;
+			total += pieces[i].Size;
+		}
+
+		vector.resize(first + total);
+
+		pool.Run(pieces.size(), [this, &pieces, &offsets, &vector, order](size_t i)
+		{
+			SliceWriter writer = { vector.data() + offsets[i] };
+
+			if (!pieces[i].WholeSubtree)
+				writer.push_back(pieces[i].Root->Data);
+			else if (order < 0)
+				PreOrderIterative(pieces[i].Root, writer);
+			else if (order == 0)
+				InOrderIterative(pieces[i].Root, writer);
+			else
+				PostOrderIterative(pieces[i].Root, writer);
+		});
+	}
+
+
+	void InOrderRecursive(const Node *node, std::vector<type> &vector)
+	{
 		if (node->Left != NULL)
-			ToVectorInOrder(node->Left, vector);
+			InOrderRecursive(node->Left, vector);
 
 		vector.push_back(node->Data);
 
 		if (node->Right != NULL)
-			ToVectorInOrder(node->Right, vector);
+			InOrderRecursive(node->Right, vector);
 	}
 
-	void ToVectorPreOrder(const BinaryTreeNode<type> *node, std::vector<type> &vector)
+	void PreOrderRecursive(const Node *node, std::vector<type> &vector)
 	{
-		if (node == NULL)
-			return;
-
 		vector.push_back(node->Data);
 
 		if (node->Left != NULL)
-			ToVectorPreOrder(node->Left, vector);
+			PreOrderRecursive(node->Left, vector);
 
 		if (node->Right != NULL)
-			ToVectorPreOrder(node->Right, vector);
+			PreOrderRecursive(node->Right, vector);
 	}
 
-	void ToVectorPostOrder(const BinaryTreeNode<type> *node, std::vector<type> &vector)
+	void PostOrderRecursive(const Node *node, std::vector<type> &vector)
 	{
-		if (node == NULL)
-			return;
-
 		if (node->Left != NULL)
-			ToVectorPostOrder(node->Left, vector);
+			PostOrderRecursive(node->Left, vector);
 
 		if (node->Right != NULL)
-			ToVectorPostOrder(node->Right, vector);
+			PostOrderRecursive(node->Right, vector);
 
 		vector.push_back(node->Data);
 	}
+
+
+	template <typename Output>
+	void InOrderIterative(const Node *node, Output &vector)
+	{
+		std::vector<const Node *> stack;
+
+		while (node != NULL || !stack.empty())
+		{
+			while (node != NULL)
+			{
+				stack.push_back(node);
+				node = node->Left;
+			}
+
+			node = stack.back();
+			stack.pop_back();
+
+			vector.push_back(node->Data);
+			node = node->Right;
+		}
+	}
+
+	template <typename Output>
+	void PreOrderIterative(const Node *node, Output &vector)
+	{
+		std::vector<const Node *> stack;
+		stack.push_back(node);
+
+		while (!stack.empty())
+		{
+			node = stack.back();
+			stack.pop_back();
+
+			vector.push_back(node->Data);
+
+			if (node->Right != NULL)
+				stack.push_back(node->Right);
+			if (node->Left != NULL)
+				stack.push_back(node->Left);
+		}
+	}
+
+	template <typename Output>
+	void PostOrderIterative(const Node *node, Output &vector)
+	{
+		std::vector<const Node *> stack;
+		const Node *lastVisited = NULL;
+
+		while (node != NULL || !stack.empty())
+		{
+			if (node != NULL)
+			{
+				stack.push_back(node);
+				node = node->Left;
+				continue;
+			}
+
+			const Node *top = stack.back();
+			if (top->Right != NULL && top->Right != lastVisited)
+			{
+				node = top->Right;
+			}
+			else
+			{
+				vector.push_back(top->Data);
+				lastVisited = top;
+				stack.pop_back();
+			}
+		}
+	}
+
+
+	// Finds the in-order predecessor of node inside its left subtree, which is
+	// either the end of the right spine or a thread already pointing at node.
+	static Node *MorrisPredecessor(Node *node)
+	{
+		Node *predecessor = node->Left;
+		while (predecessor->Right != NULL && predecessor->Right != node)
+			predecessor = predecessor->Right;
+
+		return predecessor;
+	}
+
+	void InOrderMorris(Node *node, std::vector<type> &vector)
+	{
+		while (node != NULL)
+		{
+			if (node->Left == NULL)
+			{
+				vector.push_back(node->Data);
+				node = node->Right;
+				continue;
+			}
+
+			Node *predecessor = MorrisPredecessor(node);
+			if (predecessor->Right == NULL)
+			{
+				predecessor->Right = node;
+				node = node->Left;
+			}
+			else
+			{
+				predecessor->Right = NULL;
+				vector.push_back(node->Data);
+				node = node->Right;
+			}
+		}
+	}
+
+	void PreOrderMorris(Node *node, std::vector<type> &vector)
+	{
+		while (node != NULL)
+		{
+			if (node->Left == NULL)
+			{
+				vector.push_back(node->Data);
+				node = node->Right;
+				continue;
+			}
+
+			Node *predecessor = MorrisPredecessor(node);
+			if (predecessor->Right == NULL)
+			{
+				vector.push_back(node->Data);
+				predecessor->Right = node;
+				node = node->Left;
+			}
+			else
+			{
+				predecessor->Right = NULL;
+				node = node->Right;
+			}
+		}
+	}
+
+	// Appends the chain node, node->Right, node->Right->Right, ... in reverse.
+	// The reversal is done in the output itself so no extra space is needed.
+	static void AppendRightSpineReversed(const Node *node, std::vector<type> &vector)
+	{
+		size_t first = vector.size();
+
+		for (; node != NULL; node = node->Right)
+			vector.push_back(node->Data);
+
+		std::reverse(vector.begin() + first, vector.end());
+	}
+
+	void PostOrderMorris(Node *root, std::vector<type> &vector)
+	{
+		Node *node = root;
+
+		while (node != NULL)
+		{
+			if (node->Left == NULL)
+			{
+				node = node->Right;
+				continue;
+			}
+
+			Node *predecessor = MorrisPredecessor(node);
+			if (predecessor->Right == NULL)
+			{
+				predecessor->Right = node;
+				node = node->Left;
+			}
+			else
+			{
+				predecessor->Right = NULL;
+				AppendRightSpineReversed(node->Left, vector);
+				node = node->Right;
+			}
+		}
+
+		AppendRightSpineReversed(root, vector);
+	}
+
+public:
+	TreeHelper() {}
+	~TreeHelper() {}
+
+	void ToVectorInOrder(const BinaryTreeNode<type> *node, std::vector<type> &vector, TraversalMethod method = TraverseIterative)
+	{
+		if (node == NULL)
+			return;
+
+		if (method == TraverseRecursive)
+			InOrderRecursive(node, vector);
+		else if (method == TraverseMorris)
+			InOrderMorris(const_cast<Node *>(node), vector);
+		else
+			InOrderIterative(node, vector);
+	}
+
+	void ToVectorPreOrder(const BinaryTreeNode<type> *node, std::vector<type> &vector, TraversalMethod method = TraverseIterative)
+	{
+		if (node == NULL)
+			return;
+
+		if (method == TraverseRecursive)
+			PreOrderRecursive(node, vector);
+		else if (method == TraverseMorris)
+			PreOrderMorris(const_cast<Node *>(node), vector);
+		else
+			PreOrderIterative(node, vector);
+	}
+
+	void ToVectorPostOrder(const BinaryTreeNode<type> *node, std::vector<type> &vector, TraversalMethod method = TraverseIterative)
+	{
+		if (node == NULL)
+			return;
+
+		if (method == TraverseRecursive)
+			PostOrderRecursive(node, vector);
+		else if (method == TraverseMorris)
+			PostOrderMorris(const_cast<Node *>(node), vector);
+		else
+			PostOrderIterative(node, vector);
+	}
+
+	// Parallel versions of the functions above, with the same output.  They
+	// split the tree into subtrees and dump those on pool's threads, each
+	// straight into its own part of vector, so the items land in the right
+	// place without any merging afterwards.  type must be default
+	// constructible and assignable, since vector is sized up front.
+	void ToVectorInOrderParallel(const BinaryTreeNode<type> *node, std::vector<type> &vector, WorkStealingPool &pool = WorkStealingPool::Shared())
+	{
+		ToVectorParallel(node, vector, 0, pool);
+	}
+
+	void ToVectorPreOrderParallel(const BinaryTreeNode<type> *node, std::vector<type> &vector, WorkStealingPool &pool = WorkStealingPool::Shared())
+	{
+		ToVectorParallel(node, vector, -1, pool);
+	}
+
+	void ToVectorPostOrderParallel(const BinaryTreeNode<type> *node, std::vector<type> &vector, WorkStealingPool &pool = WorkStealingPool::Shared())
+	{
+		ToVectorParallel(node, vector, 1, pool);
+	}
+
+	// Counts the nodes in the tree, one subtree per task on pool's threads.
+	size_t CountNodesParallel(const BinaryTreeNode<type> *node, WorkStealingPool &pool = WorkStealingPool::Shared())
+	{
+		int levels = 0;
+		while (((size_t)1 << levels) < pool.ThreadCount() * 8)
+			levels++;
+
+		std::vector<Piece> pieces;
+		Cut(node, 0, levels, pieces);
+
+		std::vector<size_t> counts(pieces.size(), 1);
+		pool.Run(pieces.size(), [&pieces, &counts](size_t i)
+		{
+			if (pieces[i].WholeSubtree)
+				counts[i] = CountNodes(pieces[i].Root);
+		});
+
+		size_t total = 0;
+		for (size_t i = 0; i < counts.size(); i++)
+			total += counts[i];
+
+		return total;
+	}
+
+	// Dumps a BTree in order; pass it the tree's GetRoot() just like for a
+	// BinaryTree.  The recursion is only as deep as the B-tree is tall.
+	template <int Fanout>
+	void ToVectorInOrder(const BTreeNode<type, Fanout> *node, std::vector<type> &vector)
+	{
+		if (node == NULL)
+			return;
+
+		const type *keys = node->Keys();
+		for (int i = 0; i < node->KeyCount; i++)
+		{
+			if (!node->IsLeaf)
+				ToVectorInOrder(node->Children[i], vector);
+
+			vector.push_back(keys[i]);
+		}
+
+		if (!node->IsLeaf)
+			ToVectorInOrder(node->Children[node->KeyCount], vector);
+	}
+
+	// Measures the shape of the tree at node: how tall it is against how tall
+	// it has to be, how the items spread over the levels, and how lopsided
+	// the worst node is.  The walk keeps its stack on the heap, so a tree
+	// that has degenerated into a list is measured just as safely, in O(n)
+	// time and O(height) space.  It only reads the links, so it works the
+	// same whatever balancing policy the tree uses.
+	TreeShape MeasureShape(const BinaryTreeNode<type> *node)
+	{
+		TreeShape shape;
+		shape.Count = 0;
+		shape.Height = 0;
+		shape.MinimumHeight = 0;
+		shape.AverageDepth = 0;
+		shape.LeafCount = 0;
+		shape.WorstImbalance = 0;
+
+		// Each frame is a node on the current path.  Stage 0 has yet to go
+		// left, stage 1 has yet to go right, and stage 2 is done with both.
+		struct Frame
+		{
+			const Node *Subtree;
+			int Depth;
+			int Stage;
+			int LeftHeight;
+		};
+
+		std::vector<Frame> stack;
+		double depthSum = 0;
+		int childHeight = 0;
+
+		if (node != NULL)
+		{
+			Frame root = { node, 1, 0, 0 };
+			stack.push_back(root);
+		}
+
+		while (!stack.empty())
+		{
+			Frame &frame = stack.back();
+			const Node *current = frame.Subtree;
+			int depth = frame.Depth;
+
+			if (frame.Stage == 0)
+			{
+				shape.Count++;
+				depthSum += depth;
+				if ((int)shape.NodesPerLevel.size() < depth)
+					shape.NodesPerLevel.push_back(0);
+				shape.NodesPerLevel[depth - 1]++;
+				if (current->Left == NULL && current->Right == NULL)
+					shape.LeafCount++;
+
+				frame.Stage = 1;
+				if (current->Left != NULL)
+				{
+					Frame child = { current->Left, depth + 1, 0, 0 };
+					stack.push_back(child);
+					continue;
+				}
+
+				childHeight = 0;
+			}
+
+			if (frame.Stage == 1)
+			{
+				frame.LeftHeight = childHeight;
+				frame.Stage = 2;
+				if (current->Right != NULL)
+				{
+					Frame child = { current->Right, depth + 1, 0, 0 };
+					stack.push_back(child);
+					continue;
+				}
+
+				childHeight = 0;
+			}
+
+			// childHeight is now the right subtree's height.
+			int leftHeight = frame.LeftHeight;
+			int imbalance = leftHeight > childHeight ? leftHeight - childHeight : childHeight - leftHeight;
+			if (imbalance > shape.WorstImbalance)
+				shape.WorstImbalance = imbalance;
+
+			childHeight = (leftHeight > childHeight ? leftHeight : childHeight) + 1;
+			stack.pop_back();
+		}
+
+		shape.Height = childHeight;
+		shape.AverageDepth = shape.Count == 0 ? 0 : depthSum / shape.Count;
+		for (long long capacity = 0; capacity < shape.Count; capacity = capacity * 2 + 1)
+			shape.MinimumHeight++;
+
+		return shape;
+	}
+
+
+	// Moves every item out of tree into vector in order, then clears the
+	// tree.  Nothing is copied, which matters for items that are expensive
+	// to copy or can only be moved.
+	template <typename Tree>
+	void DrainInOrder(Tree &tree, std::vector<type> &vector)
+	{
+		std::vector<Node *> stack;
+		Node *node = tree.GetRoot();
+
+		try
+		{
+			while (node != NULL || !stack.empty())
+			{
+				while (node != NULL)
+				{
+					stack.push_back(node);
+					node = node->Left;
+				}
+
+				node = stack.back();
+				stack.pop_back();
+
+				vector.push_back(std::move(node->Data));
+				node = node->Right;
+			}
+		}
+		catch (...)
+		{
+			tree.Clear();
+			throw;
+		}
+
+		tree.Clear();
+	}
 };
 
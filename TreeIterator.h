@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stddef.h>
+#include <iterator>
+
+#include "BinaryTreeNode.h"
+
+
+
+
+// Bidirectional in-order iterator over the nodes of a BinaryTree.  It walks
+// the Parent links, so it needs no stack and never copies the items; it just
+// hands out references to BinaryTreeNode::Data.  Like std::set, the items are
+// read-only through the iterator, since changing one could break the order.
+//
+// An iterator stays valid until the node it points at is removed.  end() is a
+// NULL node; it remembers where the tree keeps its root so that --end() can
+// find the largest item.
+template <typename type>
+class TreeIterator
+{
+public:
+	typedef std::bidirectional_iterator_tag iterator_category;
+	typedef type value_type;
+	typedef ptrdiff_t difference_type;
+	typedef const type *pointer;
+	typedef const type &reference;
+
+private:
+	BinaryTreeNode<type> *_node;
+	BinaryTreeNode<type> *const *_root;
+
+public:
+	TreeIterator() :
+		_node(NULL),
+		_root(NULL)
+	{}
+
+	TreeIterator(BinaryTreeNode<type> *node, BinaryTreeNode<type> *const *root) :
+		_node(node),
+		_root(root)
+	{}
+
+
+	// Returns the node the iterator points at, or NULL for end().
+	BinaryTreeNode<type> *GetNode() const
+	{
+		return _node;
+	}
+
+
+	static BinaryTreeNode<type> *Leftmost(BinaryTreeNode<type> *node)
+	{
+		if (node != NULL)
+			while (node->Left != NULL)
+				node = node->Left;
+
+		return node;
+	}
+
+	static BinaryTreeNode<type> *Rightmost(BinaryTreeNode<type> *node)
+	{
+		if (node != NULL)
+			while (node->Right != NULL)
+				node = node->Right;
+
+		return node;
+	}
+
+	// The next node in order, or NULL after the last one.
+	static BinaryTreeNode<type> *Successor(BinaryTreeNode<type> *node)
+	{
+		if (node->Right != NULL)
+			return Leftmost(node->Right);
+
+		BinaryTreeNode<type> *parent = node->Parent;
+		while (parent != NULL && node == parent->Right)
+		{
+			node = parent;
+			parent = parent->Parent;
+		}
+
+		return parent;
+	}
+
+	// The previous node in order, or NULL before the first one.
+	static BinaryTreeNode<type> *Predecessor(BinaryTreeNode<type> *node)
+	{
+		if (node->Left != NULL)
+			return Rightmost(node->Left);
+
+		BinaryTreeNode<type> *parent = node->Parent;
+		while (parent != NULL && node == parent->Left)
+		{
+			node = parent;
+			parent = parent->Parent;
+		}
+
+		return parent;
+	}
+
+
+	reference operator*() const
+	{
+		return _node->Data;
+	}
+
+	pointer operator->() const
+	{
+		return &_node->Data;
+	}
+
+	TreeIterator &operator++()
+	{
+		_node = Successor(_node);
+		return *this;
+	}
+
+	TreeIterator operator++(int)
+	{
+		TreeIterator old = *this;
+		++*this;
+		return old;
+	}
+
+	TreeIterator &operator--()
+	{
+		_node = _node == NULL ? Rightmost(*_root) : Predecessor(_node);
+		return *this;
+	}
+
+	TreeIterator operator--(int)
+	{
+		TreeIterator old = *this;
+		--*this;
+		return old;
+	}
+
+	bool operator==(const TreeIterator &other) const
+	{
+		return _node == other._node;
+	}
+
+	bool operator!=(const TreeIterator &other) const
+	{
+		return _node != other._node;
+	}
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdlib.h>
+
+
+
+
+// The operations a stats policy keeps separate counts for.
+enum TreeOperation
+{
+	OperationAdd,
+	OperationRemove,
+	OperationContains
+};
+
+
+// The Stats parameter of BinaryTree decides whether the tree counts what its
+// operations do.  The tree calls these on its stats object:
+//
+//     void Begin(TreeOperation operation);   // an Add, Remove or Contains starts
+//     void Visit(int depth);                 // it looks at a node (the root is depth 1)
+//     void Compare(int comparisons);         // it compared items this many times
+//     void Allocate();                       // it created a node
+//     void Free();                           // it destroyed a node
+//     void Rotate();                         // the balancing policy rotated
+//     void Reset();                          // BinaryTree::ResetStats was called
+
+
+// Counts nothing.  Every call is empty and inlines away, so a tree with this
+// policy (the default) runs exactly the code it would without one.
+struct NoTreeStats
+{
+	void Begin(TreeOperation operation) {}
+	void Visit(int depth) {}
+	void Compare(int comparisons) {}
+	void Allocate() {}
+	void Free() {}
+	void Rotate() {}
+	void Reset() {}
+};
+
+
+// Counts the work done by each kind of operation since the tree was built or
+// last reset.  Read it through BinaryTree::GetStats().
+struct TreeStats
+{
+	struct Counts
+	{
+		long Calls;
+		long Comparisons;
+		long NodesVisited;
+		int MaxDepth;       // deepest node any one call reached
+		long Allocations;
+		long Frees;
+		long Rotations;
+	};
+
+	Counts Add;
+	Counts Remove;
+	Counts Contains;
+
+	TreeStats()
+	{
+		Reset();
+	}
+
+	TreeStats(const TreeStats &other) :
+		Add(other.Add),
+		Remove(other.Remove),
+		Contains(other.Contains),
+		_current(&Add)
+	{}
+
+	TreeStats &operator=(const TreeStats &other)
+	{
+		Add = other.Add;
+		Remove = other.Remove;
+		Contains = other.Contains;
+		return *this;
+	}
+
+
+	void Begin(TreeOperation operation)
+	{
+		_current = operation == OperationAdd ? &Add : operation == OperationRemove ? &Remove : &Contains;
+		_current->Calls++;
+	}
+
+	void Visit(int depth)
+	{
+		_current->NodesVisited++;
+		if (depth > _current->MaxDepth)
+			_current->MaxDepth = depth;
+	}
+
+	void Compare(int comparisons)
+	{
+		_current->Comparisons += comparisons;
+	}
+
+	void Allocate()
+	{
+		_current->Allocations++;
+	}
+
+	void Free()
+	{
+		_current->Frees++;
+	}
+
+	void Rotate()
+	{
+		_current->Rotations++;
+	}
+
+	void Reset()
+	{
+		Counts zero = { 0, 0, 0, 0, 0, 0, 0 };
+		Add = zero;
+		Remove = zero;
+		Contains = zero;
+		_current = &Add;
+	}
+
+private:
+	// Where the calls between one Begin and the next are counted.
+	Counts *_current;
+};
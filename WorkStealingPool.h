@@ -0,0 +1,231 @@
+#pragma once
+
+#include <stdlib.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+
+
+
+// A fixed set of worker threads for running a batch of independent tasks.
+// Run() spreads the task numbers over one queue per thread; each thread works
+// from the back of its own queue and, once that is empty, steals from the
+// front of someone else's, so uneven tasks still keep every thread busy.  The
+// calling thread joins in as well.
+//
+// Only one Run() can be in progress at a time, and a task must not call Run()
+// on the pool it is running on.
+class WorkStealingPool
+{
+public:
+	typedef std::function<void(size_t)> Task;
+
+private:
+	struct Job
+	{
+		const Task *Function;
+		size_t Index;
+	};
+
+	struct Queue
+	{
+		std::mutex Lock;
+		std::deque<Job> Jobs;
+	};
+
+	std::vector<std::thread> _threads;
+	std::vector<Queue *> _queues;
+
+	std::mutex _lock;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+	std::mutex _runLock;
+	unsigned long _generation;
+	bool _stopping;
+
+	std::atomic<size_t> _remaining;
+	int _busy;
+	std::exception_ptr _error;
+
+	WorkStealingPool(const WorkStealingPool &);
+	WorkStealingPool &operator=(const WorkStealingPool &);
+
+
+	bool PopOwn(size_t queue, Job &job)
+	{
+		std::lock_guard<std::mutex> guard(_queues[queue]->Lock);
+		if (_queues[queue]->Jobs.empty())
+			return false;
+
+		job = _queues[queue]->Jobs.back();
+		_queues[queue]->Jobs.pop_back();
+		return true;
+	}
+
+	bool Steal(size_t thief, Job &job)
+	{
+		for (size_t i = 1; i < _queues.size(); i++)
+		{
+			Queue *victim = _queues[(thief + i) % _queues.size()];
+
+			std::lock_guard<std::mutex> guard(victim->Lock);
+			if (!victim->Jobs.empty())
+			{
+				job = victim->Jobs.front();
+				victim->Jobs.pop_front();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+
+	// Runs jobs until there are none left anywhere.
+	void Work(size_t queue)
+	{
+		Job job;
+
+		while (PopOwn(queue, job) || Steal(queue, job))
+		{
+			try
+			{
+				(*job.Function)(job.Index);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (!_error)
+					_error = std::current_exception();
+			}
+
+			if (--_remaining == 0)
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_done.notify_all();
+			}
+		}
+	}
+
+
+	void WorkerLoop(size_t queue)
+	{
+		unsigned long seen = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> guard(_lock);
+				while (!_stopping && _generation == seen)
+					_wake.wait(guard);
+
+				if (_stopping)
+					return;
+
+				seen = _generation;
+				_busy++;
+			}
+
+			Work(queue);
+
+			std::lock_guard<std::mutex> guard(_lock);
+			if (--_busy == 0)
+				_done.notify_all();
+		}
+	}
+
+public:
+	// threadCount includes the thread that calls Run(), so a pool of one runs
+	// everything on the caller.
+	explicit WorkStealingPool(unsigned threadCount = std::thread::hardware_concurrency()) :
+		_generation(0),
+		_stopping(false),
+		_remaining(0),
+		_busy(0)
+	{
+		if (threadCount == 0)
+			threadCount = 1;
+
+		for (unsigned i = 0; i < threadCount; i++)
+			_queues.push_back(new Queue);
+
+		// Queue 0 belongs to the caller of Run().
+		for (unsigned i = 1; i < threadCount; i++)
+			_threads.push_back(std::thread(&WorkStealingPool::WorkerLoop, this, (size_t)i));
+	}
+
+	~WorkStealingPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			_stopping = true;
+			_wake.notify_all();
+		}
+
+		for (size_t i = 0; i < _threads.size(); i++)
+			_threads[i].join();
+		for (size_t i = 0; i < _queues.size(); i++)
+			delete _queues[i];
+	}
+
+
+	// The number of threads that work on a Run(), counting the caller.
+	size_t ThreadCount() const
+	{
+		return _queues.size();
+	}
+
+
+	// A pool with one thread per core, shared by everyone who doesn't bring
+	// their own.
+	static WorkStealingPool &Shared()
+	{
+		static WorkStealingPool pool;
+		return pool;
+	}
+
+
+	// Calls task(i) for every i in [0, count) and returns once they have all
+	// finished.  If any of them throws, the first exception is rethrown here
+	// after the rest have run.
+	void Run(size_t count, const Task &task)
+	{
+		if (count == 0)
+			return;
+
+		std::lock_guard<std::mutex> runGuard(_runLock);
+
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			_error = std::exception_ptr();
+			_remaining = count;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				Job job = { &task, i };
+				Queue *queue = _queues[i % _queues.size()];
+
+				std::lock_guard<std::mutex> queueGuard(queue->Lock);
+				queue->Jobs.push_front(job);
+			}
+
+			_generation++;
+			_wake.notify_all();
+		}
+
+		Work(0);
+
+		std::unique_lock<std::mutex> guard(_lock);
+		while (_remaining != 0 || _busy != 0)
+			_done.wait(guard);
+
+		if (_error)
+			std::rethrow_exception(_error);
+	}
+};
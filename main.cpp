@@ -1,12 +1,23 @@
 #include <exception>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <set>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
 
 using namespace std;
 
 #include "TestCase.h"
 #include "BinaryTree.h"
 #include "TreeHelper.h"
+#include "ConcurrentTree.h"
+#include "LockCouplingTree.h"
+#include "PersistentTree.h"
+#include "MappedTree.h"
 
 struct CounterClass
 {
@@ -29,6 +40,53 @@ struct CounterClass
 int CounterClass::InstanceCount = 0;
 
 
+// Counts how often items are copied and moved, to check the tree only does
+// what it has to.
+struct MoveCounterClass
+{
+	static int CopyCount;
+	static int MoveCount;
+
+	int Data;
+	string Name;
+
+	MoveCounterClass(int data, const char *name) : Data(data), Name(name) {}
+	MoveCounterClass(const MoveCounterClass& other) : Data(other.Data), Name(other.Name) { CopyCount++; }
+	MoveCounterClass(MoveCounterClass&& other) : Data(other.Data), Name(std::move(other.Name)) { MoveCount++; }
+
+	bool operator<(const MoveCounterClass& other) const { return Data < other.Data; }
+};
+
+int MoveCounterClass::CopyCount = 0;
+int MoveCounterClass::MoveCount = 0;
+
+
+// Marks itself dead when destroyed, and every comparison checks the mark, so
+// a reader that touches a node after it was freed gets noticed.
+struct CanaryClass
+{
+	static const int Alive = 0x600D;
+	static const int Dead = 0xDEAD;
+	static atomic<int> Violations;
+
+	int Data;
+	volatile int Canary;
+
+	CanaryClass(int data) : Data(data), Canary(Alive) {}
+	CanaryClass(const CanaryClass& other) : Data(other.Data), Canary(Alive) {}
+	~CanaryClass() { Canary = Dead; }
+
+	bool operator<(const CanaryClass& other) const
+	{
+		if (Canary != Alive || other.Canary != Alive)
+			Violations++;
+		return Data < other.Data;
+	}
+};
+
+atomic<int> CanaryClass::Violations(0);
+
+
 
 
 void __ValidateVector(TestCase &tc, int expected[], int len, vector<CounterClass> &v)
@@ -838,13 +896,2836 @@ void TestPostOrder()
 
 
 
+/**************************************/
+void TestTraversalMethodsAgree()
+{
+	TestCase tc("Test recursive, iterative and Morris traversals give the same output.");
+
+	try
+	{
+		BinaryTree<CounterClass> tree;
+		TreeHelper<CounterClass> treeHelper;
+		int items[] = { 50, 30, 70, 20, 40, 60, 80, 10, 25, 35, 45, 90, 85, 95, 5 };
+		for (int i = 0; i < 15; i++)
+			tree.Add(items[i]);
+
+		TraversalMethod methods[] = { TraverseRecursive, TraverseIterative, TraverseMorris };
+		const char *names[] = { "recursive", "iterative", "Morris" };
+
+		vector<CounterClass> inOrder, preOrder, postOrder;
+		treeHelper.ToVectorInOrder(tree.GetRoot(), inOrder, TraverseRecursive);
+		treeHelper.ToVectorPreOrder(tree.GetRoot(), preOrder, TraverseRecursive);
+		treeHelper.ToVectorPostOrder(tree.GetRoot(), postOrder, TraverseRecursive);
+
+		for (int m = 0; m < 3; m++)
+		{
+			vector<CounterClass> v;
+			string msg;
+
+			treeHelper.ToVectorInOrder(tree.GetRoot(), v, methods[m]);
+			msg = string("Make sure the ") + names[m] + " in-order dump matches.";
+			tc.Assert(v == inOrder, msg.c_str());
+
+			v.clear();
+			treeHelper.ToVectorPreOrder(tree.GetRoot(), v, methods[m]);
+			msg = string("Make sure the ") + names[m] + " pre-order dump matches.";
+			tc.Assert(v == preOrder, msg.c_str());
+
+			v.clear();
+			treeHelper.ToVectorPostOrder(tree.GetRoot(), v, methods[m]);
+			msg = string("Make sure the ") + names[m] + " post-order dump matches.";
+			tc.Assert(v == postOrder, msg.c_str());
+		}
+
+		vector<CounterClass> after;
+		treeHelper.ToVectorPreOrder(tree.GetRoot(), after, TraverseRecursive);
+		tc.Assert(after == preOrder, "Make sure the Morris traversals left the tree exactly as it was.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestTraversalOfDegenerateTree()
+{
+	TestCase tc("Test traversing a tree that has degenerated into a list.");
+
+	try
+	{
+		BinaryTree<int> tree;
+		TreeHelper<int> treeHelper;
+		for (int i = 0; i < 5000; i++)
+			tree.Add(i);
+
+		vector<int> iterative, morris;
+		treeHelper.ToVectorPostOrder(tree.GetRoot(), iterative, TraverseIterative);
+		treeHelper.ToVectorPostOrder(tree.GetRoot(), morris, TraverseMorris);
+
+		tc.AssertEquals(5000, iterative.size(), "Make sure the iterative dump has every item.");
+		tc.AssertEquals(4999, iterative.front(), "Make sure the deepest item comes first.");
+		tc.Assert(iterative == morris, "Make sure the Morris dump matches the iterative one.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
 //##############################################################################
-//###   main
+//###   Iterators
+//##############################################################################
+
+/**************************************/
+void TestIteratorsWalkInOrder()
+{
+	TestCase tc("Test iterating over the tree forwards and backwards.");
+
+	try
+	{
+		BinaryTree<CounterClass> tree;
+		tree.Add(50);
+		tree.Add(30);
+		tree.Add(70);
+		tree.Add(20);
+		tree.Add(40);
+		tree.Add(60);
+		tree.Add(80);
+
+		int instancesBefore = CounterClass::InstanceCount;
+
+		int expected[] = { 20, 30, 40, 50, 60, 70, 80 };
+		int i = 0;
+		for (const CounterClass &item : tree)
+		{
+			stringstream ss;
+			ss << "Check item at index " << i;
+			tc.AssertEquals(expected[i], item.Data, ss.str().c_str());
+			i++;
+		}
+		tc.AssertEquals(7, i, "Make sure the forward walk visited every item.");
+
+		i = 7;
+		for (BinaryTree<CounterClass>::reverse_iterator it = tree.rbegin(); it != tree.rend(); ++it)
+		{
+			i--;
+			stringstream ss;
+			ss << "Check item at reverse index " << i;
+			tc.AssertEquals(expected[i], it->Data, ss.str().c_str());
+		}
+		tc.AssertEquals(0, i, "Make sure the reverse walk visited every item.");
+
+		tc.AssertEquals(80, (--tree.end())->Data, "Make sure --end() is the largest item.");
+		tc.AssertEquals(instancesBefore, CounterClass::InstanceCount, "Make sure iterating did not copy any items.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestIteratorsWithAlgorithms()
+{
+	TestCase tc("Test using tree iterators with standard algorithms.");
+
+	try
+	{
+		BinaryTree<int, AvlBalance> tree;
+		tc.Assert(tree.begin() == tree.end(), "Make sure begin() == end() on an empty tree.");
+
+		for (int i = 1; i <= 100; i++)
+			tree.Add(i * 10);
+
+		BinaryTree<int, AvlBalance>::iterator found = std::find_if(tree.begin(), tree.end(), [](int item) { return item > 455; });
+		tc.Assert(found != tree.end(), "Make sure find_if found an item.");
+		tc.AssertEquals(460, *found, "Make sure find_if stopped at the first item over 455.");
+
+		tc.AssertEquals(100, (int)std::distance(tree.begin(), tree.end()), "Make sure there are 100 steps from begin() to end().");
+
+		tree.Remove(470);
+		tc.AssertEquals(480, *++found, "Make sure the iterator is still valid after removing a different item.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Batched search
+//##############################################################################
+
+/**************************************/
+void TestContainsBatch()
+{
+	TestCase tc("Test looking up many items at once.");
+
+	try
+	{
+		BinaryTree<CounterClass> tree;
+		tree.Add(50);
+		tree.Add(30);
+		tree.Add(70);
+		tree.Add(20);
+		tree.Add(40);
+		tree.Add(60);
+		tree.Add(80);
+
+		CounterClass keys[] = { 50, 10, 20, 25, 80, 90, 40, 65, 70 };
+		bool expected[] = { true, false, true, false, true, false, true, false, true };
+		bool found[9];
+		tree.ContainsBatch(keys, 9, found);
+
+		for (int i = 0; i < 9; i++)
+		{
+			stringstream ss;
+			ss << "Check the result for " << keys[i].Data;
+			tc.AssertEquals(expected[i], found[i], ss.str().c_str());
+		}
+
+		BinaryTree<CounterClass> empty;
+		empty.ContainsBatch(keys, 9, found);
+		tc.Assert(std::find(found, found + 9, true) == found + 9, "Make sure nothing is found in an empty tree.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestContainsBatchMatchesContains()
+{
+	TestCase tc("Test batched lookups match one-at-a-time lookups.");
+
+	try
+	{
+		BinaryTree<int, AvlBalance> tree;
+		mt19937 random(99);
+		for (int i = 0; i < 5000; i++)
+		{
+			int item = (int)(random() % 20000);
+			if (!tree.Contains(item))
+				tree.Add(item);
+		}
+
+		vector<int> keys;
+		for (int i = 0; i < 1001; i++)
+			keys.push_back((int)(random() % 20000));
+
+		bool *found = new bool[keys.size()];
+		tree.ContainsBatch(&keys[0], keys.size(), found);
+
+		bool matches = true;
+		for (size_t i = 0; i < keys.size(); i++)
+			matches = matches && found[i] == tree.Contains(keys[i]);
+		delete[] found;
+
+		tc.Assert(matches, "Make sure every batched result matches Contains.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Balancing
 //##############################################################################
 
 /**************************************/
-void main()
+void TestAvlAddSortedItems()
+{
+	TestCase tc("Test adding items in order to an AVL tree.");
+
+	try
+	{
+		BinaryTree<CounterClass, AvlBalance> tree;
+		TreeHelper<CounterClass> treeHelper;
+		for (int i = 1; i <= 7; i++)
+			tree.Add(i);
+
+		tc.AssertEquals(7, tree.Count(), "Make sure count is 7 after adding test nodes.");
+
+		int expectedInOrder[] = { 1, 2, 3, 4, 5, 6, 7 };
+		vector<CounterClass> v;
+		treeHelper.ToVectorInOrder(tree.GetRoot(), v);
+		__ValidateVector(tc, expectedInOrder, 7, v);
+
+		int expectedPreOrder[] = { 4, 2, 1, 3, 6, 5, 7 };
+		v.clear();
+		treeHelper.ToVectorPreOrder(tree.GetRoot(), v);
+		__ValidateVector(tc, expectedPreOrder, 7, v);
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestAvlRemoveRebalances()
+{
+	TestCase tc("Test removing items from an AVL tree rotates it back into balance.");
+
+	try
+	{
+		BinaryTree<CounterClass, AvlBalance> tree;
+		TreeHelper<CounterClass> treeHelper;
+		for (int i = 1; i <= 7; i++)
+			tree.Add(i);
+
+		tree.Remove(1);
+		tree.Remove(3);
+		tree.Remove(2);
+		tc.AssertEquals(4, tree.Count(), "Make sure node count is 4.");
+
+		int expected[] = { 6, 4, 5, 7 };
+		vector<CounterClass> v;
+		treeHelper.ToVectorPreOrder(tree.GetRoot(), v);
+		__ValidateVector(tc, expected, 4, v);
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestAvlHeightStaysLogarithmic()
+{
+	TestCase tc("Test the height of an AVL tree built from sorted items.");
+
+	try
+	{
+		BinaryTree<CounterClass, AvlBalance> tree;
+		for (int i = 0; i < 1023; i++)
+			tree.Add(i);
+
+		tc.AssertEquals(1023, tree.Count(), "Make sure count is 1023 after adding test nodes.");
+		tc.AssertEquals(10, tree.GetRoot()->Height, "Make sure 1023 sorted items give a perfect tree of height 10.");
+
+		for (int i = 0; i < 1023; i += 2)
+			tree.Remove(i);
+
+		tc.AssertEquals(511, tree.Count(), "Make sure count is 511 after removing the even items.");
+		tc.Assert(tree.GetRoot()->Height <= 12, "Make sure the height is still within the AVL bound.");
+		tc.Assert(tree.Contains(511) && !tree.Contains(512), "Make sure the remaining items are the odd ones.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestSplayMovesAccessedItemsToRoot()
+{
+	TestCase tc("Test a splay tree moves what Add, Contains and Remove touch to the root.");
+
+	try
+	{
+		BinaryTree<CounterClass, SplayBalance, HeapNodeAllocator, SubtreeSizes> tree;
+		for (int i = 1; i <= 7; i++)
+			tree.Add(i);
+
+		tc.AssertEquals(7, tree.GetRoot()->Data.Data, "Make sure the last item added is at the root.");
+
+		tc.Assert(tree.Contains(3), "Make sure 3 is found.");
+		tc.AssertEquals(3, tree.GetRoot()->Data.Data, "Make sure the item found moves to the root.");
+
+		tc.Assert(!tree.Contains(100), "Make sure 100 isn't found.");
+		tc.AssertEquals(7, tree.GetRoot()->Data.Data, "Make sure a miss moves the last item looked at to the root.");
+
+		try
+		{
+			tree.Add(5);
+			tc.LogResult(false, "Make sure adding a duplicate throws.");
+		}
+		catch (invalid_argument &)
+		{
+		}
+		tc.AssertEquals(5, tree.GetRoot()->Data.Data, "Make sure a duplicate Add moves the item to the root.");
+
+		tree.Remove(4);
+		tc.AssertEquals(6, tree.Count(), "Make sure count is 6 after removing 4.");
+		tc.Assert(tree.GetRoot()->Data.Data == 3 || tree.GetRoot()->Data.Data == 5, "Make sure a neighbour of the removed item is at the root.");
+
+		TreeHelper<CounterClass> helper;
+		vector<CounterClass> items;
+		helper.ToVectorInOrder(tree.GetRoot(), items);
+
+		int expected[] = { 1, 2, 3, 5, 6, 7 };
+		tc.Assert(vector<CounterClass>(expected, expected + 6) == items, "Make sure TreeHelper still lists the items in order.");
+		tc.Assert(tree.Select(3) == 5 && tree.Rank(6) == 4, "Make sure splaying keeps the subtree sizes right.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestSplayKeepsHotItemsNearTheRoot()
 {
+	TestCase tc("Test a splay tree finds a few hot items faster than an AVL tree does.");
+
+	try
+	{
+		const int Size = 100000;
+		BinaryTree<int, SplayBalance, HeapNodeAllocator, NoSubtreeSizes, TreeStats> splay;
+		BinaryTree<int, AvlBalance, HeapNodeAllocator, NoSubtreeSizes, TreeStats> avl;
+
+		for (int i = 0; i < Size; i++)
+		{
+			splay.Add(i);
+			avl.Add(i);
+		}
+		tc.Assert(splay.GetStats().Add.NodesVisited <= 2L * Size, "Make sure sorted adds each take O(1) amortized.");
+
+		for (int i = 0; i < Size; i++)
+			splay.Contains(i);
+		tc.Assert(splay.GetStats().Contains.NodesVisited <= 10L * Size, "Make sure looking up every item in order takes O(1) amortized each.");
+
+		// Skewed lookups, as in a Zipfian workload: 64 hot items spread over
+		// the tree, each looked up about 30% less often than the one before.
+		// (Cycling evenly through them is the worst case for a splay tree,
+		// which does no better than the AVL tree there.)  The first thousand
+		// lookups bring the hot items up from wherever the in-order lookups
+		// left them, and aren't measured.
+		std::mt19937 random(3);
+		std::geometric_distribution<int> hot(0.3);
+		for (int i = 0; i < 17000; i++)
+		{
+			if (i == 1000)
+			{
+				splay.ResetStats();
+				avl.ResetStats();
+			}
+
+			int item = hot(random) % 64 * 1543;
+			splay.Contains(item);
+			avl.Contains(item);
+		}
+
+		double splayDepth = (double)splay.GetStats().Contains.NodesVisited / splay.GetStats().Contains.Calls;
+		double avlDepth = (double)avl.GetStats().Contains.NodesVisited / avl.GetStats().Contains.Calls;
+
+		std::ostringstream info;
+		info << "Average nodes visited per hot lookup: splay " << splayDepth << ", AVL " << avlDepth << ".";
+		tc.LogInfo(info.str().c_str());
+
+		tc.Assert(splayDepth < avlDepth / 2, "Make sure the hot items take under half the AVL tree's visits.");
+		tc.AssertEquals(Size, splay.Count(), "Make sure lookups don't change the count.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+//##############################################################################
+//###   Bulk load
+//##############################################################################
+
+/**************************************/
+void TestBuildFromSorted()
+{
+	TestCase tc("Test building a balanced tree from sorted items.");
+
+	try
+	{
+		vector<CounterClass> items;
+		for (int i = 1; i <= 7; i++)
+			items.push_back(i);
+
+		BinaryTree<CounterClass> tree(items.begin(), items.end());
+		TreeHelper<CounterClass> treeHelper;
+
+		tc.AssertEquals(7, tree.Count(), "Make sure count is 7 after building the tree.");
+
+		int expected[] = { 4, 2, 1, 3, 6, 5, 7 };
+		vector<CounterClass> v;
+		treeHelper.ToVectorPreOrder(tree.GetRoot(), v);
+		__ValidateVector(tc, expected, 7, v);
+
+		tree.Add(8);
+		tree.Remove(4);
+		tc.AssertEquals(7, tree.Count(), "Make sure the tree still works normally after the build.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestBuildFromSortedLargeIsBalanced()
+{
+	TestCase tc("Test building a large AVL tree from sorted items.");
+
+	try
+	{
+		vector<int> items;
+		for (int i = 0; i < 100000; i++)
+			items.push_back(i * 2);
+
+		BinaryTree<int, AvlBalance, PoolNodeAllocator> tree;
+		tree.BuildFromSorted(items.begin(), items.end());
+
+		tc.AssertEquals(100000, tree.Count(), "Make sure count is 100000 after building the tree.");
+		tc.AssertEquals(17, tree.GetRoot()->Height, "Make sure the height is the minimum for 100000 items.");
+		tc.Assert(tree.Contains(0) && tree.Contains(199998) && !tree.Contains(7), "Make sure lookups work on the built tree.");
+
+		for (int i = 0; i < 1000; i++)
+			tree.Add(i * 2 + 1);
+		tc.Assert(tree.GetRoot()->Height <= 18, "Make sure AVL heights from the build are kept up to date by Add.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestBuildFromSortedRejectsBadInput()
+{
+	TestCase tc("Test building a tree from unsorted or duplicate items.");
+
+	try
+	{
+		BinaryTree<CounterClass> tree;
+		tree.Add(100);
+
+		int duplicates[] = { 1, 2, 2, 3 };
+		try
+		{
+			tree.BuildFromSorted(duplicates, duplicates + 4);
+			tc.LogResult(false, "Building from duplicate items did not throw an exception.");
+		}
+		catch (exception ex)
+		{
+			tc.LogResult(true, "Building from duplicate items threw an exception.");
+		}
+
+		int unsorted[] = { 1, 3, 2 };
+		try
+		{
+			tree.BuildFromSorted(unsorted, unsorted + 3);
+			tc.LogResult(false, "Building from unsorted items did not throw an exception.");
+		}
+		catch (exception ex)
+		{
+			tc.LogResult(true, "Building from unsorted items threw an exception.");
+		}
+
+		tc.AssertEquals(1, tree.Count(), "Make sure the tree was left untouched.");
+		tc.Assert(tree.Contains(100), "Make sure the original item is still there.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+
+//##############################################################################
+//###   Move and emplace
+//##############################################################################
+
+/**************************************/
+void TestAddMovesAndEmplaceBuildsInPlace()
+{
+	TestCase tc("Test moving and emplacing items into the tree.");
+
+	try
+	{
+		BinaryTree<MoveCounterClass, AvlBalance> tree;
+		TreeHelper<MoveCounterClass> treeHelper;
+		MoveCounterClass::CopyCount = 0;
+		MoveCounterClass::MoveCount = 0;
+
+		tree.Add(MoveCounterClass(20, "twenty"));
+		tc.AssertEquals(0, MoveCounterClass::CopyCount, "Make sure adding a temporary did not copy it.");
+		tc.AssertEquals(1, MoveCounterClass::MoveCount, "Make sure adding a temporary moved it once.");
+
+		tree.Emplace(10, "ten");
+		tree.Emplace(30, "thirty");
+		tc.AssertEquals(0, MoveCounterClass::CopyCount, "Make sure emplacing did not copy.");
+		tc.AssertEquals(1, MoveCounterClass::MoveCount, "Make sure emplacing did not move.");
+		tc.AssertEquals(3, tree.Count(), "Make sure count is 3.");
+
+		try
+		{
+			tree.Emplace(10, "again");
+			tc.LogResult(false, "Emplacing a duplicate item did not throw an exception.");
+		}
+		catch (exception ex)
+		{
+			tc.LogResult(true, "Emplacing a duplicate item threw an exception.");
+		}
+		tc.AssertEquals(3, tree.Count(), "Make sure count is still 3.");
+
+		vector<MoveCounterClass> v;
+		v.reserve(3);
+		treeHelper.DrainInOrder(tree, v);
+		tc.AssertEquals(0, MoveCounterClass::CopyCount, "Make sure draining did not copy.");
+		tc.AssertEquals(0, tree.Count(), "Make sure the tree is empty after draining.");
+		tc.AssertEquals(3, v.size(), "Make sure every item was drained.");
+		tc.AssertEquals(string("ten"), v[0].Name, "Check item at index 0");
+		tc.AssertEquals(string("twenty"), v[1].Name, "Check item at index 1");
+		tc.AssertEquals(string("thirty"), v[2].Name, "Check item at index 2");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Allocators
+//##############################################################################
+
+/**************************************/
+void TestPoolAllocatorAddRemoveClear()
+{
+	TestCase tc("Test adding, removing and clearing a tree that uses the node pool.");
+
+	try
+	{
+		BinaryTree<CounterClass, AvlBalance, PoolNodeAllocator> tree;
+		TreeHelper<CounterClass> treeHelper;
+		for (int i = 0; i < 100; i++)
+			tree.Add(i);
+
+		tc.AssertEquals(100, tree.Count(), "Make sure count is 100 after adding test nodes.");
+		tc.AssertEquals(100, CounterClass::InstanceCount, "Make sure there is one instance of CounterClass per node.");
+
+		for (int i = 0; i < 100; i += 2)
+			tree.Remove(i);
+
+		tc.AssertEquals(50, tree.Count(), "Make sure count is 50 after removing the even items.");
+		tc.AssertEquals(50, CounterClass::InstanceCount, "Make sure removed nodes destroyed their data.");
+
+		vector<CounterClass> v;
+		treeHelper.ToVectorInOrder(tree.GetRoot(), v);
+		tc.AssertEquals(50, v.size(), "Make sure the in-order dump has 50 items.");
+		tc.AssertEquals(99, v.back().Data, "Make sure the last item is 99.");
+		v.clear();
+
+		tree.Clear();
+		tc.AssertEquals(0, tree.Count(), "Make sure count is 0 after Clear.");
+		tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure Clear destroyed the data in every node.");
+
+		tree.Add(7);
+		tc.Assert(tree.Contains(7), "Make sure the pool can be used again after Clear.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestPoolAllocatorReusesFreedNodes()
+{
+	TestCase tc("Test the node pool hands out removed nodes again.");
+
+	try
+	{
+		BinaryTree<int, NoBalance, PoolNodeAllocator> tree;
+		tree.Add(10);
+		tree.Add(5);
+
+		BinaryTreeNode<int> *removed = tree.GetRoot()->Left;
+		tree.Remove(5);
+		tree.Add(15);
+
+		tc.Assert(tree.GetRoot()->Right == removed, "Make sure the new node reuses the memory of the removed one.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Frozen trees
+//##############################################################################
+
+/**************************************/
+void TestFreezeContainsAndLowerBound()
+{
+	TestCase tc("Test searching a frozen copy of the tree.");
+
+	try
+	{
+		BinaryTree<CounterClass> tree;
+		tree.Add(50);
+		tree.Add(30);
+		tree.Add(70);
+		tree.Add(20);
+		tree.Add(40);
+		tree.Add(60);
+		tree.Add(80);
+
+		FrozenTree<CounterClass> frozen = tree.Freeze();
+		tc.AssertEquals(7, frozen.Count(), "Make sure the frozen tree has 7 items.");
+		tc.AssertEquals(14, CounterClass::InstanceCount, "Make sure the frozen tree holds its own copies.");
+
+		tree.Clear();
+
+		tc.Assert(frozen.Contains(20), "Make sure 20 is present.");
+		tc.Assert(frozen.Contains(50), "Make sure 50 is present.");
+		tc.Assert(frozen.Contains(80), "Make sure 80 is present.");
+		tc.Assert(!frozen.Contains(10), "Make sure 10 is not present.");
+		tc.Assert(!frozen.Contains(55), "Make sure 55 is not present.");
+		tc.Assert(!frozen.Contains(90), "Make sure 90 is not present.");
+
+		tc.AssertEquals(20, frozen.LowerBound(5)->Data, "Make sure LowerBound(5) is 20.");
+		tc.AssertEquals(40, frozen.LowerBound(40)->Data, "Make sure LowerBound(40) is 40.");
+		tc.AssertEquals(60, frozen.LowerBound(51)->Data, "Make sure LowerBound(51) is 60.");
+		tc.Assert(frozen.LowerBound(81) == NULL, "Make sure LowerBound(81) is NULL.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all items in the frozen tree.");
+}
+
+
+/**************************************/
+void TestFreezeMatchesTree()
+{
+	TestCase tc("Test a large frozen tree answers like the tree it came from.");
+
+	try
+	{
+		BinaryTree<int, AvlBalance> tree;
+		for (int i = 0; i < 10000; i++)
+			tree.Add(i * 3);
+
+		FrozenTree<int> frozen = tree.Freeze();
+		bool matches = true;
+		for (int i = -5; i < 30010; i++)
+		{
+			int expected = i <= 0 ? 0 : (i + 2) / 3 * 3;
+			const int *actual = frozen.LowerBound(i);
+
+			matches = matches && frozen.Contains(i) == tree.Contains(i);
+			matches = matches && (expected > 29997 ? actual == NULL : actual != NULL && *actual == expected);
+		}
+		tc.Assert(matches, "Make sure Contains and LowerBound match the tree for every value.");
+
+		BinaryTree<int> empty;
+		FrozenTree<int> frozenEmpty = empty.Freeze();
+		tc.Assert(!frozenEmpty.Contains(0) && frozenEmpty.LowerBound(0) == NULL, "Make sure a frozen empty tree finds nothing.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   B-tree
+//##############################################################################
+
+/**************************************/
+void TestBTreeAddRemoveSmall()
+{
+	TestCase tc("Test adding and removing items in a B-tree.");
+
+	try
+	{
+		BTree<CounterClass, 4> tree;
+		TreeHelper<CounterClass> treeHelper;
+		for (int i = 1; i <= 20; i++)
+			tree.Add(i);
+
+		tc.AssertEquals(20, tree.Count(), "Make sure count is 20 after adding test nodes.");
+
+		try
+		{
+			tree.Add(7);
+			tc.LogResult(false, "Adding a duplicate item did not throw an exception.");
+		}
+		catch (exception ex)
+		{
+			tc.LogResult(true, "Adding a duplicate item threw an exception.");
+		}
+
+		for (int i = 2; i <= 20; i += 2)
+			tree.Remove(i);
+
+		try
+		{
+			tree.Remove(4);
+			tc.LogResult(false, "Removing a missing item did not throw an exception.");
+		}
+		catch (exception ex)
+		{
+			tc.LogResult(true, "Removing a missing item threw an exception.");
+		}
+
+		tc.AssertEquals(10, tree.Count(), "Make sure count is 10 after removing the even items.");
+		tc.AssertEquals(10, CounterClass::InstanceCount, "Make sure there is one instance of CounterClass per item.");
+
+		int expected[] = { 1, 3, 5, 7, 9, 11, 13, 15, 17, 19 };
+		vector<CounterClass> v;
+		treeHelper.ToVectorInOrder(tree.GetRoot(), v);
+		__ValidateVector(tc, expected, 10, v);
+
+		tc.Assert(tree.Contains(13), "Make sure 13 is present.");
+		tc.Assert(!tree.Contains(14), "Make sure 14 is not present.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+// An item whose copy constructor throws on request, to test that a failed
+// Add leaves a tree as it was.
+struct FragileItem
+{
+	int Data;
+	static int InstanceCount;
+	static bool ThrowOnCopy;
+
+	FragileItem(int data) : Data(data) { InstanceCount++; }
+	FragileItem(const FragileItem& other) : Data(other.Data)
+	{
+		if (ThrowOnCopy)
+			throw runtime_error("FragileItem: copy failed.");
+		InstanceCount++;
+	}
+	FragileItem(FragileItem&& other) noexcept : Data(other.Data) { InstanceCount++; }
+	~FragileItem() { InstanceCount--; }
+
+	bool operator<(const FragileItem& other) const { return Data < other.Data; }
+};
+
+int FragileItem::InstanceCount = 0;
+bool FragileItem::ThrowOnCopy = false;
+
+
+/**************************************/
+void TestBTreeAddThatThrowsLeavesTreeIntact()
+{
+	TestCase tc("Test a B-tree Add whose copy throws leaves the tree as it was.");
+
+	try
+	{
+		BTree<FragileItem, 8> tree;
+		int items[] = { 1, 3, 7, 9 };
+		for (int i = 0; i < 4; i++)
+			tree.Add(FragileItem(items[i]));
+
+		FragileItem five(5);
+		FragileItem::ThrowOnCopy = true;
+		try
+		{
+			tree.Add(five);
+			tc.LogResult(false, "Make sure the failed copy throws out of Add.");
+		}
+		catch (runtime_error &)
+		{
+		}
+		FragileItem::ThrowOnCopy = false;
+
+		tc.AssertEquals(4, tree.Count(), "Make sure count is still 4.");
+		tc.Assert(tree.Contains(FragileItem(1)) && tree.Contains(FragileItem(3)) && tree.Contains(FragileItem(7)) && tree.Contains(FragileItem(9)), "Make sure every item is still there, including the last one in the node.");
+		tc.Assert(!tree.Contains(FragileItem(5)), "Make sure 5 was not added.");
+		tc.AssertEquals(5, FragileItem::InstanceCount, "Make sure there are just the four items and five.");
+
+		tree.Add(five);
+		tc.Assert(tree.Count() == 5 && tree.Contains(FragileItem(5)), "Make sure 5 can be added once copying works.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	FragileItem::ThrowOnCopy = false;
+	tc.AssertEquals(0, FragileItem::InstanceCount, "Make sure every item was destroyed once.");
+}
+
+
+/**************************************/
+void TestBTreeMatchesStdSet()
+{
+	TestCase tc("Test a B-tree against std::set with random adds and removes.");
+
+	try
+	{
+		BTree<int, 6> tree;
+		TreeHelper<int> treeHelper;
+		set<int> reference;
+		mt19937 random(12345);
+		bool matches = true;
+
+		for (int i = 0; i < 20000 && matches; i++)
+		{
+			int item = (int)(random() % 2000);
+
+			if (reference.count(item))
+			{
+				tree.Remove(item);
+				reference.erase(item);
+			}
+			else
+			{
+				tree.Add(item);
+				reference.insert(item);
+			}
+
+			if (i % 1000 == 0)
+			{
+				vector<int> v;
+				treeHelper.ToVectorInOrder(tree.GetRoot(), v);
+				matches = v == vector<int>(reference.begin(), reference.end());
+			}
+		}
+
+		tc.Assert(matches, "Make sure the in-order dump always matched std::set.");
+		tc.AssertEquals((int)reference.size(), tree.Count(), "Make sure the counts match.");
+
+		for (int i = 0; i < 2000; i++)
+			matches = matches && tree.Contains(i) == (reference.count(i) != 0);
+		tc.Assert(matches, "Make sure Contains agrees with std::set for every item.");
+
+		for (set<int>::iterator it = reference.begin(); it != reference.end(); ++it)
+			tree.Remove(*it);
+		tc.AssertEquals(0, tree.Count(), "Make sure count is 0 after removing everything.");
+		tc.Assert(tree.GetRoot() == NULL, "Make sure the last node was freed.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Concurrent readers
+//##############################################################################
+
+/**************************************/
+void TestConcurrentTreeBasics()
+{
+	TestCase tc("Test adding, removing and searching a concurrent tree.");
+
+	try
+	{
+		ConcurrentTree<CounterClass> tree;
+		int items[] = { 50, 30, 70, 20, 40, 60, 80, 65, 75 };
+		for (int i = 0; i < 9; i++)
+			tree.Add(items[i]);
+
+		tc.AssertEquals(9, tree.Count(), "Make sure count is 9 after adding test nodes.");
+
+		try
+		{
+			tree.Add(40);
+			tc.LogResult(false, "Adding a duplicate item did not throw an exception.");
+		}
+		catch (exception ex)
+		{
+			tc.LogResult(true, "Adding a duplicate item threw an exception.");
+		}
+
+		tree.Remove(20);
+		tree.Remove(70);
+		tree.Remove(50);
+		tc.AssertEquals(6, tree.Count(), "Make sure count is 6 after removing leaf, inner and root nodes.");
+
+		tc.Assert(!tree.Contains(20) && !tree.Contains(70) && !tree.Contains(50), "Make sure the removed items are gone.");
+		tc.Assert(tree.Contains(30) && tree.Contains(40) && tree.Contains(60), "Make sure 30, 40 and 60 are present.");
+		tc.Assert(tree.Contains(65) && tree.Contains(75) && tree.Contains(80), "Make sure 65, 75 and 80 are present.");
+
+		try
+		{
+			tree.Remove(20);
+			tc.LogResult(false, "Removing a missing item did not throw an exception.");
+		}
+		catch (exception ex)
+		{
+			tc.LogResult(true, "Removing a missing item threw an exception.");
+		}
+
+		tree.Clear();
+		tc.AssertEquals(0, tree.Count(), "Make sure count is 0 after Clear.");
+		tc.Assert(!tree.Contains(30), "Make sure nothing is found after Clear.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestConcurrentReadersDuringWrites()
+{
+	TestCase tc("Test many readers searching while one writer adds and removes.");
+
+	try
+	{
+		ConcurrentTree<CanaryClass> tree;
+		const int Range = 2000;
+		CanaryClass::Violations = 0;
+
+		// The even items stay put the whole time; readers must always find them.
+		for (int i = 0; i < Range; i += 2)
+			tree.Add((i * 7919) % Range);
+
+		atomic<bool> writing(true);
+		atomic<int> missed(0);
+		atomic<long> reads(0);
+
+		vector<thread> readers;
+		for (int r = 0; r < 4; r++)
+		{
+			readers.push_back(thread([&tree, &writing, &missed, &reads, r]()
+			{
+				mt19937 random(r);
+				long count = 0;
+
+				while (writing)
+				{
+					int item = (int)(random() % Range);
+					bool found = tree.Contains(item);
+
+					if (item % 2 == 0 && !found)
+						missed++;
+					count++;
+				}
+
+				reads += count;
+			}));
+		}
+
+		mt19937 random(4242);
+		set<int> odd;
+		for (int i = 0; i < 100000; i++)
+		{
+			int item = (int)(random() % (Range / 2)) * 2 + 1;
+
+			if (odd.count(item))
+			{
+				tree.Remove(item);
+				odd.erase(item);
+			}
+			else
+			{
+				tree.Add(item);
+				odd.insert(item);
+			}
+		}
+
+		writing = false;
+		for (size_t r = 0; r < readers.size(); r++)
+			readers[r].join();
+
+		tc.AssertEquals(0, missed, "Make sure readers always found the items that were never removed.");
+		tc.AssertEquals(0, CanaryClass::Violations, "Make sure no reader touched a freed node.");
+		tc.AssertEquals(Range / 2 + (int)odd.size(), tree.Count(), "Make sure the count matches the writer's bookkeeping.");
+		tc.Assert(reads > 0, "Make sure the readers got to run.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Concurrent writers
+//##############################################################################
+
+/**************************************/
+void TestLockCouplingTreeBasics()
+{
+	TestCase tc("Test adding, removing and searching a lock-coupling tree.");
+
+	try
+	{
+		LockCouplingTree<CounterClass> tree;
+		int items[] = { 50, 30, 70, 20, 40, 60, 80, 65, 75 };
+		for (int i = 0; i < 9; i++)
+			tree.Add(items[i]);
+
+		tc.AssertEquals(9, tree.Count(), "Make sure count is 9 after adding test nodes.");
+
+		try
+		{
+			tree.Add(65);
+			tc.LogResult(false, "Adding a duplicate item did not throw an exception.");
+		}
+		catch (exception ex)
+		{
+			tc.LogResult(true, "Adding a duplicate item threw an exception.");
+		}
+
+		tree.Remove(20);
+		tree.Remove(70);
+		tree.Remove(50);
+		tc.AssertEquals(6, tree.Count(), "Make sure count is 6 after removing leaf, inner and root nodes.");
+
+		tc.Assert(!tree.Contains(20) && !tree.Contains(70) && !tree.Contains(50), "Make sure the removed items are gone.");
+		tc.Assert(tree.Contains(30) && tree.Contains(40) && tree.Contains(60), "Make sure 30, 40 and 60 are present.");
+		tc.Assert(tree.Contains(65) && tree.Contains(75) && tree.Contains(80), "Make sure 65, 75 and 80 are present.");
+
+		try
+		{
+			tree.Remove(70);
+			tc.LogResult(false, "Removing a missing item did not throw an exception.");
+		}
+		catch (exception ex)
+		{
+			tc.LogResult(true, "Removing a missing item threw an exception.");
+		}
+
+		tree.Clear();
+		tc.AssertEquals(0, tree.Count(), "Make sure count is 0 after Clear.");
+		tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure Clear deleted every item.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestLockCouplingTreeScaling()
+{
+	TestCase tc("Test many writers adding and removing disjoint items.");
+
+	try
+	{
+		const int ItemsPerThread = 20000;
+		int threadCounts[] = { 1, 2, 4, 8 };
+
+		for (int t = 0; t < 4; t++)
+		{
+			int threadCount = threadCounts[t];
+			LockCouplingTree<int> tree;
+
+			// Items nobody touches, so the writers share a realistically deep
+			// tree rather than starting from nothing.
+			mt19937 random(7);
+			for (int i = 0; i < 10000; i++)
+			{
+				int item = -1 - (int)(random() % 1000000);
+				if (!tree.Contains(item))
+					tree.Add(item);
+			}
+			int baseCount = tree.Count();
+
+			atomic<int> errors(0);
+			vector<thread> writers;
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+			for (int w = 0; w < threadCount; w++)
+			{
+				writers.push_back(thread([&tree, &errors, w, threadCount]()
+				{
+					// Thread w owns the items congruent to w modulo threadCount.
+					vector<int> items;
+					for (int i = 0; i < ItemsPerThread; i++)
+						items.push_back(i * threadCount + w);
+					shuffle(items.begin(), items.end(), mt19937(w));
+
+					for (size_t i = 0; i < items.size(); i++)
+						tree.Add(items[i]);
+					for (size_t i = 0; i < items.size(); i++)
+						if (!tree.Contains(items[i]))
+							errors++;
+					for (size_t i = 0; i < items.size(); i += 2)
+						tree.Remove(items[i]);
+				}));
+			}
+
+			for (size_t w = 0; w < writers.size(); w++)
+				writers[w].join();
+
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			double operations = 2.5 * ItemsPerThread * threadCount;
+
+			stringstream ss;
+			ss << threadCount << " thread(s): " << (long)(operations / seconds) << " operations/second";
+			tc.LogResult(true, ss.str().c_str());
+
+			tc.AssertEquals(0, errors, "Make sure every writer found all of its own items.");
+			tc.AssertEquals(baseCount + threadCount * ItemsPerThread / 2, tree.Count(), "Make sure the count is exact.");
+		}
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Parallel traversals
+//##############################################################################
+
+/**************************************/
+void TestParallelTraversalsMatchSequential()
+{
+	TestCase tc("Test parallel traversals give the same output as the sequential ones.");
+
+	try
+	{
+		BinaryTree<int> tree;
+		TreeHelper<int> treeHelper;
+		WorkStealingPool pool(4);
+
+		std::mt19937 random(12);
+		std::uniform_int_distribution<int> values(0, 1000000);
+		while (tree.Count() < 50000)
+		{
+			int value = values(random);
+			if (!tree.Contains(value))
+				tree.Add(value);
+		}
+
+		vector<int> expected, actual;
+
+		treeHelper.ToVectorInOrder(tree.GetRoot(), expected);
+		treeHelper.ToVectorInOrderParallel(tree.GetRoot(), actual, pool);
+		tc.Assert(actual == expected, "Make sure the parallel in-order dump matches.");
+
+		expected.clear();
+		actual.clear();
+		treeHelper.ToVectorPreOrder(tree.GetRoot(), expected);
+		treeHelper.ToVectorPreOrderParallel(tree.GetRoot(), actual, pool);
+		tc.Assert(actual == expected, "Make sure the parallel pre-order dump matches.");
+
+		expected.clear();
+		actual.clear();
+		treeHelper.ToVectorPostOrder(tree.GetRoot(), expected);
+		treeHelper.ToVectorPostOrderParallel(tree.GetRoot(), actual, pool);
+		tc.Assert(actual == expected, "Make sure the parallel post-order dump matches.");
+
+		tc.AssertEquals(50000, (int)treeHelper.CountNodesParallel(tree.GetRoot(), pool), "Make sure the parallel count matches.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestParallelTraversalsEdgeCases()
+{
+	TestCase tc("Test parallel traversals of empty and small trees, appending to a vector.");
+
+	try
+	{
+		BinaryTree<CounterClass> tree;
+		TreeHelper<CounterClass> treeHelper;
+		WorkStealingPool pool(4);
+
+		vector<CounterClass> v;
+		treeHelper.ToVectorInOrderParallel(tree.GetRoot(), v, pool);
+		tc.AssertEquals(0, (int)v.size(), "Make sure an empty tree dumps nothing.");
+		tc.AssertEquals(0, (int)treeHelper.CountNodesParallel(tree.GetRoot(), pool), "Make sure an empty tree counts zero.");
+
+		int items[] = { 50, 30, 70, 20, 40, 60, 80 };
+		for (int i = 0; i < 7; i++)
+			tree.Add(items[i]);
+
+		v.push_back(CounterClass(1));
+		treeHelper.ToVectorPreOrderParallel(tree.GetRoot(), v, pool);
+
+		vector<CounterClass> expected;
+		expected.push_back(CounterClass(1));
+		treeHelper.ToVectorPreOrder(tree.GetRoot(), expected);
+		tc.Assert(v == expected, "Make sure the dump is appended after what was already in the vector.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+
+//##############################################################################
+//###   Order statistics
+//##############################################################################
+
+/**************************************/
+void TestSelectAndRank()
+{
+	TestCase tc("Test Select and Rank through adds and removes.");
+
+	try
+	{
+		BinaryTree<CounterClass, NoBalance, HeapNodeAllocator, SubtreeSizes> tree;
+		int items[] = { 50, 30, 70, 20, 40, 60, 80, 35, 45, 65 };
+		for (int i = 0; i < 10; i++)
+			tree.Add(items[i]);
+
+		tc.AssertEquals(20, tree.Select(0).Data, "Make sure Select(0) is the smallest item.");
+		tc.AssertEquals(45, tree.Select(4).Data, "Make sure Select finds an item in the middle.");
+		tc.AssertEquals(80, tree.Select(9).Data, "Make sure Select(Count() - 1) is the largest item.");
+		tc.AssertEquals(0, tree.Rank(10), "Make sure Rank of a value below everything is 0.");
+		tc.AssertEquals(3, tree.Rank(40), "Make sure Rank of an item is its position.");
+		tc.AssertEquals(6, tree.Rank(55), "Make sure Rank works for a value not in the tree.");
+		tc.AssertEquals(10, tree.Rank(99), "Make sure Rank of a value above everything is Count().");
+
+		// Two children, with the successor further down.
+		tree.Remove(50);
+		tc.AssertEquals(60, tree.Select(5).Data, "Make sure Select skips a removed node.");
+		tc.AssertEquals(5, tree.Rank(60), "Make sure Rank counts one fewer after a remove.");
+
+		tree.Remove(20);
+		tree.Remove(80);
+		tc.AssertEquals(30, tree.Select(0).Data, "Make sure Select(0) moves up after removing the smallest.");
+		tc.AssertEquals(70, tree.Select(tree.Count() - 1).Data, "Make sure Select finds the new largest.");
+
+		bool threw = false;
+		try
+		{
+			tree.Select(tree.Count());
+		}
+		catch (out_of_range &)
+		{
+			threw = true;
+		}
+		tc.Assert(threw, "Make sure Select throws when k is past the end.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestSelectAndRankMatchStdSet()
+{
+	TestCase tc("Test Select and Rank on a balanced tree against a sorted std::set.");
+
+	try
+	{
+		BinaryTree<int, AvlBalance, PoolNodeAllocator, SubtreeSizes> tree;
+		std::set<int> expected;
+
+		std::mt19937 random(13);
+		std::uniform_int_distribution<int> values(0, 5000);
+		for (int i = 0; i < 20000; i++)
+		{
+			int value = values(random);
+			if (expected.count(value) != 0)
+			{
+				tree.Remove(value);
+				expected.erase(value);
+			}
+			else
+			{
+				tree.Add(value);
+				expected.insert(value);
+			}
+		}
+
+		bool allMatch = true;
+		int k = 0;
+		for (std::set<int>::iterator it = expected.begin(); it != expected.end(); ++it, k++)
+		{
+			if (tree.Select(k) != *it || tree.Rank(*it) != k || tree.Rank(*it + 1) != k + 1)
+				allMatch = false;
+		}
+		tc.Assert(allMatch, "Make sure every position and rank matches std::set after random adds and removes.");
+
+		std::vector<int> sorted(expected.begin(), expected.end());
+		tree.BuildFromSorted(sorted.begin(), sorted.end());
+		tc.AssertEquals(sorted[sorted.size() / 3], tree.Select((int)sorted.size() / 3), "Make sure a bulk-loaded tree has its sizes set.");
+		tc.AssertEquals((int)sorted.size() / 3, tree.Rank(sorted[sorted.size() / 3]), "Make sure Rank works on a bulk-loaded tree.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Range queries
+//##############################################################################
+
+/**************************************/
+void TestBoundsAndRanges()
+{
+	TestCase tc("Test LowerBound, UpperBound, CountInRange and VisitRange.");
+
+	try
+	{
+		BinaryTree<CounterClass> tree;
+		int items[] = { 50, 30, 70, 20, 40, 60, 80 };
+		for (int i = 0; i < 7; i++)
+			tree.Add(items[i]);
+
+		tc.AssertEquals(40, tree.LowerBound(40)->Data, "Make sure LowerBound finds an item that is there.");
+		tc.AssertEquals(50, tree.LowerBound(41)->Data, "Make sure LowerBound finds the next item up.");
+		tc.AssertEquals(50, tree.UpperBound(40)->Data, "Make sure UpperBound skips an equal item.");
+		tc.AssertEquals(20, tree.UpperBound(5)->Data, "Make sure UpperBound below everything is the smallest item.");
+		tc.Assert(tree.LowerBound(81) == tree.end(), "Make sure LowerBound past the largest item is end().");
+		tc.Assert(tree.UpperBound(80) == tree.end(), "Make sure UpperBound of the largest item is end().");
+
+		tc.AssertEquals(3, tree.CountInRange(30, 60), "Make sure CountInRange includes low and leaves out high.");
+		tc.AssertEquals(7, tree.CountInRange(0, 100), "Make sure CountInRange can cover the whole tree.");
+		tc.AssertEquals(0, tree.CountInRange(61, 69), "Make sure CountInRange of a gap is 0.");
+		tc.AssertEquals(0, tree.CountInRange(60, 30), "Make sure CountInRange of a backwards range is 0.");
+
+		vector<int> visited;
+		tree.VisitRange(25, 65, [&visited](const CounterClass &item) { visited.push_back(item.Data); });
+		int expected[] = { 30, 40, 50, 60 };
+		tc.Assert(visited == vector<int>(expected, expected + 4), "Make sure VisitRange visits the items in the range in order.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestRangeQueriesMatchStdSet()
+{
+	TestCase tc("Test range queries with and without subtree sizes against std::set.");
+
+	try
+	{
+		BinaryTree<int, AvlBalance> plain;
+		BinaryTree<int, AvlBalance, HeapNodeAllocator, SubtreeSizes> sized;
+		std::set<int> expected;
+
+		std::mt19937 random(14);
+		std::uniform_int_distribution<int> values(0, 10000);
+		for (int i = 0; i < 3000; i++)
+		{
+			int value = values(random);
+			if (expected.insert(value).second)
+			{
+				plain.Add(value);
+				sized.Add(value);
+			}
+		}
+
+		bool allMatch = true;
+		for (int i = 0; i < 500; i++)
+		{
+			int low = values(random);
+			int high = low + values(random) / 20;
+
+			std::set<int>::iterator lower = expected.lower_bound(low);
+			std::set<int>::iterator upper = expected.upper_bound(low);
+			int count = (int)std::distance(lower, expected.lower_bound(high));
+
+			if ((lower == expected.end()) != (plain.LowerBound(low) == plain.end()) || (lower != expected.end() && *lower != *plain.LowerBound(low)))
+				allMatch = false;
+			if ((upper == expected.end()) != (plain.UpperBound(low) == plain.end()) || (upper != expected.end() && *upper != *plain.UpperBound(low)))
+				allMatch = false;
+			if (plain.CountInRange(low, high) != count || sized.CountInRange(low, high) != count)
+				allMatch = false;
+
+			int visited = 0;
+			plain.VisitRange(low, high, [&visited](int) { visited++; });
+			if (visited != count)
+				allMatch = false;
+		}
+		tc.Assert(allMatch, "Make sure every bound and range count matches std::set.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Split, join and set operations
+//##############################################################################
+
+// Checks every node of a tree built with AvlBalance and SubtreeSizes: the
+// Parent links, the stored heights and sizes, and the AVL balance.
+template <typename type>
+bool IsConsistentAvlTree(const BinaryTreeNode<type> *node, const BinaryTreeNode<type> *parent, int &height, int &size)
+{
+	if (node == NULL)
+	{
+		height = 0;
+		size = 0;
+		return true;
+	}
+
+	int leftHeight, leftSize, rightHeight, rightSize;
+	if (!IsConsistentAvlTree<type>(node->Left, node, leftHeight, leftSize) || !IsConsistentAvlTree<type>(node->Right, node, rightHeight, rightSize))
+		return false;
+
+	height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+	size = leftSize + rightSize + 1;
+
+	return node->Parent == parent && node->Height == height && node->Size == size && leftHeight - rightHeight <= 1 && rightHeight - leftHeight <= 1;
+}
+
+template <typename Tree>
+bool IsConsistentAvlTree(Tree &tree)
+{
+	int height, size;
+	return IsConsistentAvlTree(tree.GetRoot(), (decltype(tree.GetRoot()))NULL, height, size) && size == tree.Count();
+}
+
+
+/**************************************/
+void TestSplitAndJoin()
+{
+	TestCase tc("Test splitting a tree in two and joining it back.");
+
+	try
+	{
+		BinaryTree<CounterClass, AvlBalance, HeapNodeAllocator, SubtreeSizes> tree, greater;
+		for (int i = 0; i < 1000; i++)
+			tree.Add((i * 7919) % 1000);
+
+		tree.Split(600, greater);
+		tc.AssertEquals(600, tree.Count(), "Make sure the items below the key stay behind.");
+		tc.AssertEquals(400, greater.Count(), "Make sure the key and everything above it moved.");
+		tc.AssertEquals(599, tree.Select(599).Data, "Make sure the largest item left is just below the key.");
+		tc.AssertEquals(600, greater.Select(0).Data, "Make sure the key itself moved.");
+		tc.Assert(IsConsistentAvlTree(tree) && IsConsistentAvlTree(greater), "Make sure both halves are valid AVL trees with the right sizes.");
+		tc.AssertEquals(1000, CounterClass::InstanceCount, "Make sure no item was copied or freed.");
+
+		tree.Split(1000, greater);
+		tc.AssertEquals(0, greater.Count(), "Make sure splitting above everything leaves greater empty.");
+
+		BinaryTree<CounterClass, AvlBalance, HeapNodeAllocator, SubtreeSizes> small;
+		small.Add(2000);
+		small.Add(2001);
+		tree.Join(small);
+		tc.AssertEquals(602, tree.Count(), "Make sure a short tree joins onto the end.");
+
+		bool threw = false;
+		try
+		{
+			greater.Add(1500);
+			tree.Join(greater);
+		}
+		catch (invalid_argument &)
+		{
+			threw = true;
+		}
+		tc.Assert(threw, "Make sure Join throws when the items overlap.");
+		tc.AssertEquals(602, tree.Count(), "Make sure a failed Join changes nothing.");
+		greater.Clear();
+
+		BinaryTree<CounterClass, AvlBalance, HeapNodeAllocator, SubtreeSizes> large;
+		for (int i = 5000; i < 9000; i++)
+			large.Add(i);
+		tree.Join(large);
+		tc.AssertEquals(4602, tree.Count(), "Make sure a tall tree joins onto the end.");
+		tc.AssertEquals(0, large.Count(), "Make sure the joined tree is left empty.");
+		tc.Assert(IsConsistentAvlTree(tree), "Make sure the joined tree is a valid AVL tree with the right sizes.");
+		tc.AssertEquals(5000, tree.Select(602).Data, "Make sure the items are in order after the join.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestSetOperationsMatchStdSet()
+{
+	TestCase tc("Test union, intersection and difference against std::set.");
+
+	try
+	{
+		typedef BinaryTree<int, AvlBalance, PoolNodeAllocator, SubtreeSizes> Tree;
+
+		std::mt19937 random(15);
+		bool allMatch = true;
+		bool allConsistent = true;
+
+		for (int round = 0; round < 30; round++)
+		{
+			// Mix evenly sized sets with lopsided ones.
+			std::uniform_int_distribution<int> values(0, 4000);
+			int sizeA = 1 + round * 97 % 2000;
+			int sizeB = round % 3 == 0 ? 1 + round % 7 : 1 + round * 61 % 2000;
+
+			std::set<int> setA, setB;
+			for (int i = 0; i < sizeA; i++)
+				setA.insert(values(random));
+			for (int i = 0; i < sizeB; i++)
+				setB.insert(values(random));
+
+			for (int op = 0; op < 3; op++)
+			{
+				Tree a, b;
+				for (std::set<int>::iterator it = setA.begin(); it != setA.end(); ++it)
+					a.Add(*it);
+				for (std::set<int>::iterator it = setB.begin(); it != setB.end(); ++it)
+					b.Add(*it);
+
+				std::vector<int> expected;
+				if (op == 0)
+				{
+					a.UnionWith(b);
+					std::set_union(setA.begin(), setA.end(), setB.begin(), setB.end(), std::back_inserter(expected));
+				}
+				else if (op == 1)
+				{
+					a.IntersectWith(b);
+					std::set_intersection(setA.begin(), setA.end(), setB.begin(), setB.end(), std::back_inserter(expected));
+				}
+				else
+				{
+					a.DifferenceWith(b);
+					std::set_difference(setA.begin(), setA.end(), setB.begin(), setB.end(), std::back_inserter(expected));
+				}
+
+				if (std::vector<int>(a.begin(), a.end()) != expected || a.Count() != (int)expected.size() || b.Count() != 0)
+					allMatch = false;
+				if (!IsConsistentAvlTree(a))
+					allConsistent = false;
+			}
+		}
+
+		tc.Assert(allMatch, "Make sure every result matches std::set and the other tree is left empty.");
+		tc.Assert(allConsistent, "Make sure every result is a valid AVL tree with the right sizes.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestSetOperationsReuseNodes()
+{
+	TestCase tc("Test set operations keep this tree's items and copy nothing.");
+
+	try
+	{
+		BinaryTree<MoveCounterClass> a, b;
+		for (int i = 0; i < 10; i++)
+		{
+			a.Emplace(i, "a");
+			b.Emplace(i + 5, "b");
+		}
+
+		MoveCounterClass::CopyCount = 0;
+		MoveCounterClass::MoveCount = 0;
+		a.UnionWith(b);
+
+		tc.AssertEquals(15, a.Count(), "Make sure the union has every item once.");
+		tc.AssertEquals(0, b.Count(), "Make sure the other tree is left empty.");
+		tc.AssertEquals(0, MoveCounterClass::CopyCount + MoveCounterClass::MoveCount, "Make sure no item was copied or moved.");
+		tc.Assert(a.LowerBound(MoveCounterClass(5, ""))->Name == "a", "Make sure an item in both trees is this tree's copy.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestSetOperationsOnTallTrees()
+{
+	TestCase tc("Test set operations on splay trees a million items tall.");
+
+	try
+	{
+		typedef BinaryTree<int, SplayBalance> SplayTree;
+		const int itemCount = 1000000;
+
+		// Sorted adds leave a splay tree as one long left spine.
+		SplayTree evens, threes;
+		for (int i = 0; i < itemCount; i++)
+		{
+			evens.Add(2 * i);
+			threes.Add(3 * i);
+		}
+
+		evens.UnionWith(threes);
+		tc.AssertEquals(itemCount + itemCount - (itemCount + 2) / 3, evens.Count(), "Make sure the union counts multiples of 6 once.");
+		tc.Assert(evens.Contains(2999997) && evens.Contains(1999998) && !evens.Contains(1), "Make sure the union holds both trees' items.");
+
+		SplayTree both, threesAgain;
+		for (int i = 0; i < itemCount; i++)
+		{
+			both.Add(2 * i);
+			threesAgain.Add(3 * i);
+		}
+		both.IntersectWith(threesAgain);
+		tc.AssertEquals((itemCount + 2) / 3, both.Count(), "Make sure the intersection keeps the multiples of 6.");
+
+		SplayTree items, odds;
+		for (int i = 0; i < itemCount; i++)
+		{
+			items.Add(i);
+			odds.Add(i);
+		}
+		for (int i = 0; i < itemCount; i += 2)
+			odds.Remove(i);
+		items.DifferenceWith(odds);
+		tc.AssertEquals(itemCount / 2, items.Count(), "Make sure the difference keeps the even items.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Persistent trees
+//##############################################################################
+
+/**************************************/
+void TestPersistentVersionsAreIndependent()
+{
+	TestCase tc("Test persistent versions don't see each other's changes and share nodes.");
+
+	try
+	{
+		PersistentTree<CounterClass> empty;
+		PersistentTree<CounterClass> tree = empty;
+		for (int i = 0; i < 1023; i++)
+			tree = tree.Add(i);
+
+		tc.AssertEquals(0, empty.Count(), "Make sure the first version is still empty.");
+		tc.AssertEquals(1023, tree.Count(), "Make sure count is 1023 after adding test nodes.");
+		tc.AssertEquals(10, tree.GetRoot()->Height, "Make sure 1023 sorted items give a perfect tree of height 10.");
+		tc.AssertEquals(1023, CounterClass::InstanceCount, "Make sure the nodes no version uses any more were freed.");
+
+		PersistentTree<CounterClass> added = tree.Add(2000);
+		tc.Assert(CounterClass::InstanceCount - 1023 <= 13, "Make sure Add copies only the path to the new item.");
+		tc.Assert(added.Contains(2000) && !tree.Contains(2000), "Make sure only the new version has the new item.");
+
+		PersistentTree<CounterClass> removed = tree.Remove(511);
+		tc.Assert(!removed.Contains(511) && tree.Contains(511) && added.Contains(511), "Make sure only the new version lost the item.");
+		tc.AssertEquals(1022, removed.Count(), "Make sure count is 1022 after removing an item.");
+
+		bool threw = false;
+		try
+		{
+			removed.Remove(511);
+		}
+		catch (out_of_range &)
+		{
+			threw = true;
+		}
+		tc.Assert(threw, "Make sure Remove throws when the item is not in the version.");
+
+		threw = false;
+		try
+		{
+			tree.Add(5);
+		}
+		catch (invalid_argument &)
+		{
+			threw = true;
+		}
+		tc.Assert(threw, "Make sure Add throws on a duplicate.");
+
+		for (int i = 0; i < 1023; i += 2)
+			tree = tree.Remove(i);
+		tc.AssertEquals(511, tree.Count(), "Make sure count is 511 after removing the even items.");
+		tc.Assert(tree.GetRoot()->Height <= 12, "Make sure the height is still within the AVL bound.");
+
+		vector<int> items;
+		tree.VisitRange(100, 110, [&items](const CounterClass &item) { items.push_back(item.Data); });
+		int expected[] = { 101, 103, 105, 107, 109 };
+		tc.Assert(items == vector<int>(expected, expected + 5), "Make sure VisitRange sees the right items in order.");
+
+		int visited = 0;
+		added.VisitAll([&visited](const CounterClass &) { visited++; });
+		tc.AssertEquals(1024, visited, "Make sure an old version still has all its items.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+/**************************************/
+void TestPersistentSnapshotsDuringWrites()
+{
+	TestCase tc("Test readers holding persistent snapshots while a writer makes new versions.");
+
+	try
+	{
+		// Each version holds a run of consecutive items, give or take the one
+		// being moved.  A torn read would show a gap or a wrong count.
+		const int Window = 200;
+		PersistentTree<int> latest;
+		mutex latestLock;
+		for (int i = 0; i < Window; i++)
+			latest = latest.Add(i);
+
+		atomic<bool> writing(true);
+		atomic<int> torn(0);
+
+		vector<thread> readers;
+		for (int r = 0; r < 3; r++)
+		{
+			readers.push_back(thread([&latest, &latestLock, &writing, &torn]()
+			{
+				while (writing)
+				{
+					PersistentTree<int> snapshot;
+					{
+						lock_guard<mutex> guard(latestLock);
+						snapshot = latest;
+					}
+
+					int count = 0, previous = -1;
+					bool gap = false;
+					snapshot.VisitAll([&count, &previous, &gap](int item)
+					{
+						if (previous != -1 && item != previous + 1)
+							gap = true;
+						previous = item;
+						count++;
+					});
+
+					if (gap || count != snapshot.Count())
+						torn++;
+				}
+			}));
+		}
+
+		for (int i = Window; i < Window + 20000; i++)
+		{
+			PersistentTree<int> next = latest.Add(i).Remove(i - Window);
+
+			lock_guard<mutex> guard(latestLock);
+			latest = next;
+		}
+
+		writing = false;
+		for (size_t r = 0; r < readers.size(); r++)
+			readers[r].join();
+
+		tc.AssertEquals(0, (int)torn, "Make sure every snapshot was consistent.");
+		tc.AssertEquals(Window, latest.Count(), "Make sure the last version has the full window.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Saved trees
+//##############################################################################
+
+/**************************************/
+void TestSaveAndMap()
+{
+	TestCase tc("Test saving a tree and searching it through a MappedTree.");
+	const char *path = "TestSaveAndMap.tree";
+
+	try
+	{
+		BinaryTree<int, AvlBalance> tree;
+		for (int i = 0; i < 5000; i++)
+			tree.Add(i * 3);
+		tree.Save(path);
+
+		MappedTree<int> mapped(path);
+		tc.AssertEquals(5000, mapped.Count(), "Make sure the mapped tree has every item.");
+		tc.Assert(mapped.VerifyChecksum(), "Make sure the checksum matches.");
+
+		bool allMatch = true;
+		for (int i = -2; i < 15005; i++)
+		{
+			const int *bound = mapped.LowerBound(i);
+			int expected = (i + 2) / 3 * 3;
+
+			if (mapped.Contains(i) != tree.Contains(i) || (expected < 15000 ? bound == NULL || *bound != expected : bound != NULL))
+				allMatch = false;
+		}
+		tc.Assert(allMatch, "Make sure Contains and LowerBound match the tree.");
+
+		vector<int> visited, expected;
+		mapped.VisitRange(100, 130, [&visited](int item) { visited.push_back(item); });
+		tree.VisitRange(100, 130, [&expected](int item) { expected.push_back(item); });
+		tc.Assert(visited == expected, "Make sure VisitRange visits the same items in order.");
+
+		visited.clear();
+		mapped.VisitRange(-100, 100000, [&visited](int item) { visited.push_back(item); });
+		tc.Assert(visited == vector<int>(tree.begin(), tree.end()), "Make sure a range over everything visits every item.");
+
+		BinaryTree<int> empty;
+		empty.Save(path);
+		mapped.Open(path);
+		tc.AssertEquals(0, mapped.Count(), "Make sure an empty tree saves and opens.");
+		tc.Assert(!mapped.Contains(0), "Make sure an empty mapped tree contains nothing.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	remove(path);
+}
+
+
+/**************************************/
+void TestMappedTreeRejectsBadFiles()
+{
+	TestCase tc("Test MappedTree refuses files that aren't tree files of its type.");
+	const char *path = "TestMappedTreeRejectsBadFiles.tree";
+
+	try
+	{
+		BinaryTree<int> tree;
+		for (int i = 0; i < 100; i++)
+			tree.Add(i);
+		tree.Save(path);
+
+		bool threw = false;
+		try
+		{
+			MappedTree<double> mapped(path);
+		}
+		catch (runtime_error &)
+		{
+			threw = true;
+		}
+		tc.Assert(threw, "Make sure a file of a different item type is refused.");
+
+		// Flip one byte in the items.
+		FILE *file = fopen(path, "r+b");
+		fseek(file, sizeof(TreeFile::Header) + 10 * sizeof(int), SEEK_SET);
+		fputc(0x55, file);
+		fclose(file);
+
+		MappedTree<int> damaged(path);
+		tc.Assert(!damaged.VerifyChecksum(), "Make sure a damaged item fails the checksum.");
+		damaged.Close();
+
+		file = fopen(path, "wb");
+		fputs("TREEFILE but not really", file);
+		fclose(file);
+
+		threw = false;
+		try
+		{
+			MappedTree<int> mapped(path);
+		}
+		catch (runtime_error &)
+		{
+			threw = true;
+		}
+		tc.Assert(threw, "Make sure a file that isn't a tree file is refused.");
+
+		threw = false;
+		try
+		{
+			MappedTree<int> mapped("TestMappedTreeRejectsBadFiles.missing");
+		}
+		catch (runtime_error &)
+		{
+			threw = true;
+		}
+		tc.Assert(threw, "Make sure a missing file is refused.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	remove(path);
+}
+
+
+/**************************************/
+void TestMappedTreeRejectsBadHeaders()
+{
+	TestCase tc("Test MappedTree refuses headers whose count or item offset don't fit the file.");
+	const char *path = "TestMappedTreeRejectsBadHeaders.tree";
+
+	try
+	{
+		// Just a header: Count + 1 wraps to the 0 items that follow it.
+		TreeFile::Header header = TreeFile::MakeHeader<int>(0);
+		header.Count = UINT64_MAX;
+
+		FILE *file = fopen(path, "wb");
+		fwrite(&header, sizeof(header), 1, file);
+		fclose(file);
+
+		bool threw = false;
+		try
+		{
+			MappedTree<int> mapped;
+			mapped.Open(path);
+		}
+		catch (runtime_error &)
+		{
+			threw = true;
+		}
+		tc.Assert(threw, "Make sure a count too large for the file is refused.");
+
+		// Items that start inside the header.
+		header = TreeFile::MakeHeader<int>(15);
+		header.ItemsOffset = 0;
+
+		file = fopen(path, "wb");
+		fwrite(&header, sizeof(header), 1, file);
+		fclose(file);
+
+		threw = false;
+		try
+		{
+			MappedTree<int> mapped;
+			mapped.Open(path);
+		}
+		catch (runtime_error &)
+		{
+			threw = true;
+		}
+		tc.Assert(threw, "Make sure items overlapping the header are refused.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	remove(path);
+}
+
+
+
+//##############################################################################
+//###   Operation stats
+//##############################################################################
+
+/**************************************/
+void TestTreeStatsCounts()
+{
+	TestCase tc("Test TreeStats counts the work done by Add, Remove and Contains.");
+
+	try
+	{
+		BinaryTree<int, AvlBalance, HeapNodeAllocator, NoSubtreeSizes, TreeStats> tree;
+		for (int i = 1; i <= 7; i++)
+			tree.Add(i);
+
+		const TreeStats &stats = tree.GetStats();
+		tc.AssertEquals(7, (int)stats.Add.Calls, "Make sure every Add is counted.");
+		tc.AssertEquals(7, (int)stats.Add.Allocations, "Make sure every new node is counted.");
+		tc.AssertEquals(4, (int)stats.Add.Rotations, "Make sure adding 1 to 7 in order takes four rotations.");
+		tc.AssertEquals(3, stats.Add.MaxDepth, "Make sure the deepest node looked at is counted.");
+
+		tree.Contains(7);
+		tree.Contains(0);
+		tc.AssertEquals(2, (int)stats.Contains.Calls, "Make sure every Contains is counted.");
+		tc.AssertEquals(6, (int)stats.Contains.NodesVisited, "Make sure each node on the way down is counted.");
+		tc.AssertEquals(9, (int)stats.Contains.Comparisons, "Make sure a right turn costs two comparisons and a left turn one.");
+
+		tree.Remove(4);
+		tc.AssertEquals(3, (int)stats.Remove.NodesVisited, "Make sure the walk to the successor is counted.");
+		tc.AssertEquals(3, stats.Remove.MaxDepth, "Make sure the successor's depth is counted.");
+		tc.AssertEquals(1, (int)stats.Remove.Frees, "Make sure the freed node is counted.");
+
+		try
+		{
+			tree.Add(3);
+		}
+		catch (invalid_argument &)
+		{
+		}
+		tc.AssertEquals(8, (int)stats.Add.Calls, "Make sure a failed Add is still counted.");
+		tc.AssertEquals(7, (int)stats.Add.Allocations, "Make sure a duplicate allocates nothing.");
+
+		tree.ResetStats();
+		tc.AssertEquals(0, (int)(stats.Add.Calls + stats.Remove.Calls + stats.Contains.Calls), "Make sure ResetStats clears the counts.");
+		tc.AssertEquals(0, stats.Add.MaxDepth, "Make sure ResetStats clears the depth.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Lookup cache
+//##############################################################################
+
+/**************************************/
+void TestLookupCacheAnswersRepeatedLookups()
+{
+	TestCase tc("Test the lookup cache answers repeated Contains calls and follows Add, Remove and Clear.");
+
+	try
+	{
+		BinaryTree<int, AvlBalance, HeapNodeAllocator, NoSubtreeSizes, TreeStats, LookupCache> tree;
+		for (int i = 0; i < 1000; i++)
+			tree.Add(i);
+
+		LookupCache<int> &cache = tree.GetLookupCache();
+		const TreeStats &stats = tree.GetStats();
+
+		for (int i = 0; i < 10; i++)
+			tree.Contains(5);
+		tc.AssertEquals(9, (int)cache.Hits(), "Make sure every lookup after the first is a hit.");
+		tc.AssertEquals(1, (int)cache.Misses(), "Make sure only the first lookup misses.");
+		tc.AssertEquals(stats.Contains.MaxDepth, (int)stats.Contains.NodesVisited, "Make sure only the first lookup walks the tree.");
+
+		tc.Assert(!tree.Contains(5000) && !tree.Contains(5000), "Make sure a missing item is reported missing twice.");
+		tc.AssertEquals(10, (int)cache.Hits(), "Make sure a \"no\" is cached too.");
+
+		tree.Add(5000);
+		tc.Assert(tree.Contains(5000), "Make sure Add corrects a cached \"no\".");
+		tree.Remove(5);
+		tc.Assert(!tree.Contains(5), "Make sure Remove corrects a cached \"yes\".");
+		tc.AssertEquals(12, (int)cache.Hits(), "Make sure both were answered from the cache.");
+
+		tree.Clear();
+		tc.Assert(!tree.Contains(7), "Make sure Clear forgets the cached answers.");
+		tree.Add(7);
+		tc.Assert(tree.Contains(7), "Make sure an item added after Clear is found.");
+
+		cache.ResetCounts();
+		tc.Assert(cache.Hits() == 0 && cache.Misses() == 0 && cache.HitRate() == 0, "Make sure ResetCounts clears the counts.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestLookupCacheMatchesStdSet()
+{
+	TestCase tc("Test a cached tree against std::set through adds, removes and whole-tree changes.");
+
+	try
+	{
+		typedef BinaryTree<int, AvlBalance, HeapNodeAllocator, SubtreeSizes, NoTreeStats, LookupCache> Tree;
+
+		// Few enough keys that most of them stay cached, so stale answers
+		// would show.
+		const int Range = 500;
+		std::mt19937 random(24);
+		Tree tree;
+		std::set<int> expected;
+		bool allMatch = true;
+
+		for (int round = 0; round < 40; round++)
+		{
+			for (int i = 0; i < 2000; i++)
+			{
+				int item = (int)(random() % Range);
+				bool present = expected.count(item) != 0;
+
+				if (random() % 4 == 0)
+				{
+					if (present)
+					{
+						tree.Remove(item);
+						expected.erase(item);
+					}
+					else
+					{
+						tree.Add(item);
+						expected.insert(item);
+					}
+				}
+				else if (tree.Contains(item) != present)
+					allMatch = false;
+			}
+
+			// Move items out and back in through the whole-tree operations.
+			Tree other;
+			int key = (int)(random() % Range);
+			if (round % 3 == 0)
+			{
+				tree.Split(key, other);
+				for (int i = 0; i < Range; i++)
+				{
+					if (tree.Contains(i) != (i < key && expected.count(i) != 0) || other.Contains(i) != (i >= key && expected.count(i) != 0))
+						allMatch = false;
+				}
+				tree.Join(other);
+			}
+			else if (round % 3 == 1)
+			{
+				// Each set operation empties its argument, so it takes two.
+				Tree restored;
+				for (std::set<int>::iterator it = expected.lower_bound(key); it != expected.end(); ++it)
+				{
+					other.Add(*it);
+					restored.Add(*it);
+				}
+
+				tree.DifferenceWith(other);
+				for (int i = 0; i < Range; i++)
+				{
+					if (tree.Contains(i) != (i < key && expected.count(i) != 0))
+						allMatch = false;
+				}
+				tree.UnionWith(restored);
+			}
+			else
+			{
+				std::vector<int> items(expected.begin(), expected.end());
+				tree.BuildFromSorted(items.begin(), items.end());
+			}
+
+			for (int i = 0; i < Range; i++)
+			{
+				if (tree.Contains(i) != (expected.count(i) != 0))
+					allMatch = false;
+			}
+		}
+
+		tc.Assert(allMatch, "Make sure every cached answer matches std::set.");
+		tc.Assert(tree.GetLookupCache().HitRate() > 0.5, "Make sure most lookups of a small key range hit the cache.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Transparent lookup
+//##############################################################################
+
+// Orders CounterClass items largest first, and compares them with plain ints
+// as well, counting how often it does.
+struct CounterClassDescending
+{
+	typedef void is_transparent;
+
+	static int MixedCalls;
+
+	bool operator()(const CounterClass &left, const CounterClass &right) const
+	{
+		return left.Data > right.Data;
+	}
+
+	bool operator()(const CounterClass &left, int right) const
+	{
+		MixedCalls++;
+		return left.Data > right;
+	}
+
+	bool operator()(int left, const CounterClass &right) const
+	{
+		MixedCalls++;
+		return left > right.Data;
+	}
+};
+
+int CounterClassDescending::MixedCalls = 0;
+
+
+/**************************************/
+void TestTransparentLookupBuildsNoTemporaries()
+{
+	TestCase tc("Test Contains, Find and Remove with a transparent comparator take keys without building items.");
+
+	try
+	{
+		// Long enough that every std::string has to allocate.
+		vector<string> names;
+		for (int i = 0; i < 100; i++)
+		{
+			ostringstream name;
+			name << "an item name long enough to live on the heap, number " << i;
+			names.push_back(name.str());
+		}
+
+		BinaryTree<string, AvlBalance, HeapNodeAllocator, NoSubtreeSizes, NoTreeStats, NoLookupCache, TransparentLess> tree;
+		BinaryTree<string, AvlBalance> plain;
+		for (int i = 0; i < 100; i += 2)
+		{
+			tree.Add(names[i]);
+			plain.Add(names[i]);
+		}
+
+		int found = 0;
+		tc.AssertAllocationsAtMost(0, [&]()
+		{
+			for (int i = 0; i < 100; i++)
+			{
+				found += tree.Contains(names[i].c_str());
+				found += tree.Find(names[i].c_str()) != tree.end();
+			}
+		}, "Make sure looking up a const char * builds no std::string.");
+		tc.AssertEquals(100, found, "Make sure each even item was found by both Contains and Find.");
+
+		long before = TestCase::AllocationCount();
+		plain.Contains(names[0].c_str());
+		tc.Assert(TestCase::AllocationCount() > before, "Make sure the default comparator does build one.");
+
+		tc.AssertEquals(names[10], *tree.Find(names[10].c_str()), "Make sure Find returns the item.");
+		tc.Assert(tree.Find(names[11].c_str()) == tree.end(), "Make sure Find returns end() for a missing item.");
+
+		tc.AssertAllocationsAtMost(0, [&]()
+		{
+			tree.Remove(names[10].c_str());
+		}, "Make sure removing by const char * builds no std::string.");
+		tc.Assert(tree.Count() == 49 && !tree.Contains(names[10]), "Make sure the item was removed.");
+
+		try
+		{
+			tree.Remove(names[11].c_str());
+			tc.LogResult(false, "Make sure removing a missing key throws.");
+		}
+		catch (out_of_range &)
+		{
+		}
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestCustomComparator()
+{
+	TestCase tc("Test a tree ordered by a custom comparator, searched with plain ints.");
+
+	try
+	{
+		BinaryTree<CounterClass, AvlBalance, HeapNodeAllocator, SubtreeSizes, NoTreeStats, NoLookupCache, CounterClassDescending> tree;
+		for (int i = 1; i <= 7; i++)
+			tree.Add(i);
+
+		int expected[] = { 7, 6, 5, 4, 3, 2, 1 };
+		tc.Assert(vector<CounterClass>(tree.begin(), tree.end()) == vector<CounterClass>(expected, expected + 7), "Make sure the items come out largest first.");
+		tc.AssertEquals(7, tree.Select(0).Data, "Make sure Select follows the comparator.");
+		tc.AssertEquals(4, (*tree.LowerBound(4)).Data, "Make sure LowerBound follows the comparator.");
+		tc.AssertEquals(3, tree.CountInRange(6, 3), "Make sure CountInRange counts 6, 5 and 4 when the order is reversed.");
+
+		CounterClassDescending::MixedCalls = 0;
+		int instances = CounterClass::InstanceCount;
+		tc.Assert(tree.Contains(3) && !tree.Contains(8), "Make sure Contains finds 3 and not 8 by int.");
+		tc.Assert(CounterClassDescending::MixedCalls > 0, "Make sure the ints were compared with the items directly.");
+
+		BinaryTree<CounterClass, AvlBalance, HeapNodeAllocator, SubtreeSizes, NoTreeStats, NoLookupCache, CounterClassDescending>::iterator it = tree.Find(5);
+		tc.Assert(it != tree.end() && *it == 5 && *++it == 4, "Make sure Find by int lands on 5, followed by 4.");
+
+		tree.Remove(4);
+		tc.AssertEquals(instances - 1, CounterClass::InstanceCount, "Make sure Remove by int freed exactly the one item.");
+		tc.Assert(!tree.Contains(4) && tree.Count() == 6, "Make sure 4 is gone.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure destructor cleans up all nodes in the tree.");
+}
+
+
+
+//##############################################################################
+//###   Shape diagnostics
+//##############################################################################
+
+/**************************************/
+void TestMeasureShape()
+{
+	TestCase tc("Test MeasureShape on balanced, lopsided and empty trees.");
+
+	try
+	{
+		TreeHelper<int> treeHelper;
+
+		BinaryTree<int> empty;
+		TreeShape shape = treeHelper.MeasureShape(empty.GetRoot());
+		tc.AssertEquals(0, shape.Count, "Make sure an empty tree has no items.");
+		tc.AssertEquals(0, shape.Height, "Make sure an empty tree has height 0.");
+		tc.AssertEquals(0, (int)shape.NodesPerLevel.size(), "Make sure an empty tree has no levels.");
+
+		// Drawn on its side, root on the left and larger items higher up:
+		//
+		//                  90
+		//             80
+		//        70
+		//   50
+		//             40
+		//        30
+		//             20
+		BinaryTree<int> tree;
+		int items[] = { 50, 30, 70, 20, 40, 80, 90 };
+		for (int i = 0; i < 7; i++)
+			tree.Add(items[i]);
+
+		shape = treeHelper.MeasureShape(tree.GetRoot());
+		tc.AssertEquals(7, shape.Count, "Make sure every item is counted.");
+		tc.AssertEquals(4, shape.Height, "Make sure the height is the longest path.");
+		tc.AssertEquals(3, shape.MinimumHeight, "Make sure 7 items could fit in 3 levels.");
+		tc.AssertEquals(3, shape.LeafCount, "Make sure the leaves are counted.");
+		tc.AssertEquals(2, shape.WorstImbalance, "Make sure the worst node is 70, with nothing on its left and two levels on its right.");
+		int levels[] = { 1, 2, 3, 1 };
+		tc.Assert(shape.NodesPerLevel == vector<int>(levels, levels + 4), "Make sure the nodes are counted per level.");
+		tc.Assert(shape.AverageDepth > 2.56 && shape.AverageDepth < 2.58, "Make sure the average depth is 18 / 7.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestMeasureShapeOfDegenerateTree()
+{
+	TestCase tc("Test MeasureShape on a tree that has degenerated into a long list.");
+
+	try
+	{
+		TreeHelper<int> treeHelper;
+		BinaryTree<int> tree;
+		for (int i = 0; i < 5000; i++)
+			tree.Add(i);
+
+		TreeShape shape = treeHelper.MeasureShape(tree.GetRoot());
+		tc.AssertEquals(5000, shape.Count, "Make sure every item is counted.");
+		tc.AssertEquals(5000, shape.Height, "Make sure the height is the whole list.");
+		tc.AssertEquals(13, shape.MinimumHeight, "Make sure 5000 items could fit in 13 levels.");
+		tc.AssertEquals(4999, shape.WorstImbalance, "Make sure the root is the most lopsided node.");
+		tc.AssertEquals(1, shape.LeafCount, "Make sure a list has one leaf.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   Differential stress
+//##############################################################################
+
+// The stress tests run TestCase::StressOperations() random operations, seeded
+// by TestCase::Seed(), on a tree and on a std::set side by side and stop at
+// the first place they disagree.  Run them with --stress-ops=10000000 to test
+// at production sizes, and with the --seed a failure reports to replay it.
+enum StressKind
+{
+	StressAdd,
+	StressRemove,
+	StressContains,
+	StressClear
+};
+
+struct StressOp
+{
+	StressKind Kind;
+	int Key;
+};
+
+
+// Compares the whole tree with expected, through TreeHelper and the
+// iterators.  Returns what went wrong, or an empty string.
+template <typename Tree>
+std::string CheckStressTree(Tree &tree, const std::set<int> &expected, bool checkBalance)
+{
+	TreeHelper<CounterClass> helper;
+	std::vector<CounterClass> inOrder, preOrder, postOrder;
+
+	helper.ToVectorInOrder(tree.GetRoot(), inOrder);
+	helper.ToVectorPreOrder(tree.GetRoot(), preOrder);
+	helper.ToVectorPostOrder(tree.GetRoot(), postOrder);
+
+	std::vector<CounterClass> sorted(expected.begin(), expected.end());
+	if (inOrder != sorted)
+		return "ToVectorInOrder disagreed with std::set";
+	if (std::vector<CounterClass>(tree.begin(), tree.end()) != sorted)
+		return "The iterators disagreed with std::set";
+
+	std::sort(preOrder.begin(), preOrder.end());
+	std::sort(postOrder.begin(), postOrder.end());
+	if (preOrder != sorted || postOrder != sorted)
+		return "ToVectorPreOrder or ToVectorPostOrder lost or repeated items";
+
+	if (checkBalance && !IsConsistentAvlTree(tree))
+		return "The tree's links, heights, sizes or balance went wrong";
+
+	return "";
+}
+
+
+// Mixes adds, removes and lookups of keys drawn from a range an eighth the
+// length of the run, so the tree grows to a few thousand items per ten
+// thousand operations and then both hits and misses; now and then it clears
+// the tree.  Every operation checks its result, Count() and
+// CounterClass::InstanceCount, and the whole tree is checked sixteen times
+// over the run.  The operations that didn't throw are then replayed on a
+// fresh tree alone, to report how fast it ran them.
+template <typename Tree>
+void RunDifferentialStress(TestCase &tc, bool checkBalance)
+{
+	long operations = TestCase::StressOperations();
+	unsigned seed = TestCase::Seed();
+
+	int keyRange = (int)std::max(64L, operations / 8);
+	long checkEvery = std::max(1000L, operations / 16);
+
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int> keys(0, keyRange - 1);
+	std::uniform_int_distribution<int> kinds(0, 99);
+	std::uniform_int_distribution<int> clears(0, keyRange * 2);
+
+	Tree tree;
+	std::set<int> expected;
+	std::vector<StressOp> replay;
+	std::string failure;
+
+	for (long i = 0; i < operations && failure.empty(); i++)
+	{
+		StressOp op;
+		int kind = kinds(random);
+		op.Key = keys(random);
+		op.Kind = clears(random) == 0 ? StressClear : kind < 45 ? StressAdd : kind < 75 ? StressRemove : StressContains;
+
+		bool present = expected.count(op.Key) != 0;
+		bool threw = false;
+
+		switch (op.Kind)
+		{
+		case StressAdd:
+			try
+			{
+				tree.Add(CounterClass(op.Key));
+			}
+			catch (invalid_argument &)
+			{
+				threw = true;
+			}
+
+			if (threw != present)
+				failure = present ? "Add accepted a duplicate" : "Add threw for a new item";
+			expected.insert(op.Key);
+			break;
+
+		case StressRemove:
+			try
+			{
+				tree.Remove(CounterClass(op.Key));
+			}
+			catch (out_of_range &)
+			{
+				threw = true;
+			}
+
+			if (threw == present)
+				failure = present ? "Remove threw for an item in the tree" : "Remove didn't throw for a missing item";
+			expected.erase(op.Key);
+			break;
+
+		case StressContains:
+			if (tree.Contains(CounterClass(op.Key)) != present)
+				failure = "Contains disagreed with std::set";
+			break;
+
+		case StressClear:
+			tree.Clear();
+			expected.clear();
+			break;
+		}
+
+		if (!threw)
+			replay.push_back(op);
+
+		if (failure.empty() && tree.Count() != (int)expected.size())
+			failure = "Count() disagreed with std::set";
+		if (failure.empty() && CounterClass::InstanceCount != tree.Count())
+			failure = "CounterClass::InstanceCount drifted from Count()";
+		if (failure.empty() && ((i + 1) % checkEvery == 0 || i + 1 == operations))
+			failure = CheckStressTree(tree, expected, checkBalance);
+
+		if (!failure.empty())
+		{
+			std::ostringstream where;
+			where << failure << " at operation " << i << " (--seed=" << seed << " --stress-ops=" << operations << ").";
+			failure = where.str();
+		}
+	}
+
+	tc.Assert(failure.empty(), failure.empty() ? "Make sure every operation and every check matched std::set." : failure.c_str());
+
+	tree.Clear();
+	tc.AssertEquals(0, CounterClass::InstanceCount, "Make sure clearing the tree frees every item.");
+
+	Tree fresh;
+	long found = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < replay.size(); i++)
+	{
+		const StressOp &op = replay[i];
+
+		if (op.Kind == StressAdd)
+			fresh.Add(CounterClass(op.Key));
+		else if (op.Kind == StressRemove)
+			fresh.Remove(CounterClass(op.Key));
+		else if (op.Kind == StressContains)
+			found += fresh.Contains(CounterClass(op.Key));
+		else
+			fresh.Clear();
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	fresh.Clear();
+
+	std::ostringstream info;
+	info << replay.size() << " operations (seed " << seed << ", " << found << " hits) replayed in "
+		<< seconds * 1000 << " ms: " << (long)(seconds > 0 ? replay.size() / seconds : 0) << " ops/sec.";
+	tc.LogInfo(info.str().c_str());
+}
+
+
+/**************************************/
+void TestStressPlainTreeMatchesStdSet()
+{
+	TestCase tc("Test a plain tree against std::set with long random sequences of operations.");
+
+	try
+	{
+		RunDifferentialStress<BinaryTree<CounterClass> >(tc, false);
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestStressAvlTreeMatchesStdSet()
+{
+	TestCase tc("Test an AVL tree with subtree sizes against std::set with long random sequences of operations.");
+
+	try
+	{
+		RunDifferentialStress<BinaryTree<CounterClass, AvlBalance, HeapNodeAllocator, SubtreeSizes> >(tc, true);
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestStressSplayTreeMatchesStdSet()
+{
+	TestCase tc("Test a splay tree against std::set with long random sequences of operations.");
+
+	try
+	{
+		RunDifferentialStress<BinaryTree<CounterClass, SplayBalance> >(tc, false);
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestStressPoolTreeMatchesStdSet()
+{
+	TestCase tc("Test an AVL tree on a pool allocator against std::set with long random sequences of operations.");
+
+	try
+	{
+		RunDifferentialStress<BinaryTree<CounterClass, AvlBalance, PoolNodeAllocator, SubtreeSizes> >(tc, true);
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+
+//##############################################################################
+//###   Performance gates
+//##############################################################################
+
+/**************************************/
+void TestSearchesDontAllocate()
+{
+	TestCase tc("Test searching and iterating allocate nothing, and a pool tree allocates in slabs.");
+
+	try
+	{
+		BinaryTree<int, AvlBalance> tree;
+		for (int i = 0; i < 10000; i++)
+			tree.Add((i * 7919) % 10000);
+
+		tc.AssertAllocationsAtMost(0, [&tree]()
+		{
+			for (int i = 0; i < 10000; i++)
+				tree.Contains(i);
+		}, "Make sure Contains allocates nothing.");
+
+		long sum = 0;
+		tc.AssertAllocationsAtMost(0, [&tree, &sum]()
+		{
+			for (BinaryTree<int, AvlBalance>::iterator it = tree.begin(); it != tree.end(); ++it)
+				sum += *it;
+		}, "Make sure iterating allocates nothing.");
+		tc.AssertEquals(49995000, (int)sum, "Make sure the iteration saw every item.");
+
+		BinaryTree<int, AvlBalance, PoolNodeAllocator> pool;
+		tc.AssertAllocationsAtMost(20, [&pool]()
+		{
+			for (int i = 0; i < 10000; i++)
+				pool.Add(i);
+		}, "Make sure 10000 Adds into a pool tree take only a handful of slab allocations.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+/**************************************/
+void TestContainsIsFastEnough()
+{
+	TestCase tc("Test Contains on a balanced tree of 100000 items stays under a generous time limit.");
+
+	try
+	{
+		BinaryTree<int, AvlBalance> tree;
+		for (int i = 0; i < 100000; i++)
+			tree.Add((int)((i * 7919LL) % 100000));
+
+		// Far above what any build should need, so only a real regression
+		// (say, a lost balance) trips it.
+		int found = 0;
+		tc.AssertFasterThan(5000, 100000, [&tree, &found]()
+		{
+			for (int i = 0; i < 100000; i++)
+				found += tree.Contains((int)((i * 104729LL) % 100000));
+		}, "Make sure a Contains takes less than 5 microseconds.");
+		tc.AssertEquals(100000, found, "Make sure every item was found.");
+	}
+	catch (exception &ex)
+	{
+		tc.LogException(ex);
+	}
+}
+
+
+
+//##############################################################################
+//###   main
+//##############################################################################
+
+/**************************************/
+int main(int argc, char *argv[])
+{
+	TestCase::ParseArguments(argc, argv);
+
 	// Basic tests
 	TestCreateEmptyTree();
 	TestCallClearOnAnEmptyTree();
@@ -877,8 +3758,107 @@ void main()
 	// Pre/post order
 	TestPreOrder();
 	TestPostOrder();
+	TestTraversalMethodsAgree();
+	TestTraversalOfDegenerateTree();
+
+	// Batched search
+	TestContainsBatch();
+	TestContainsBatchMatchesContains();
+
+	// Iterators
+	TestIteratorsWalkInOrder();
+	TestIteratorsWithAlgorithms();
+
+	// Balancing
+	TestAvlAddSortedItems();
+	TestAvlRemoveRebalances();
+	TestAvlHeightStaysLogarithmic();
+	TestSplayMovesAccessedItemsToRoot();
+	TestSplayKeepsHotItemsNearTheRoot();
+
+	// Bulk load
+	TestBuildFromSorted();
+	TestBuildFromSortedLargeIsBalanced();
+	TestBuildFromSortedRejectsBadInput();
+
+	// Move and emplace
+	TestAddMovesAndEmplaceBuildsInPlace();
+
+	// Allocators
+	TestPoolAllocatorAddRemoveClear();
+	TestPoolAllocatorReusesFreedNodes();
+
+	// Frozen trees
+	TestFreezeContainsAndLowerBound();
+	TestFreezeMatchesTree();
+
+	// B-tree
+	TestBTreeAddRemoveSmall();
+	TestBTreeMatchesStdSet();
+	TestBTreeAddThatThrowsLeavesTreeIntact();
+
+	// Concurrent readers
+	TestConcurrentTreeBasics();
+	TestConcurrentReadersDuringWrites();
+
+	// Concurrent writers
+	TestLockCouplingTreeBasics();
+	TestLockCouplingTreeScaling();
+
+	// Parallel traversals
+	TestParallelTraversalsMatchSequential();
+	TestParallelTraversalsEdgeCases();
+
+	// Order statistics
+	TestSelectAndRank();
+	TestSelectAndRankMatchStdSet();
+
+	// Range queries
+	TestBoundsAndRanges();
+	TestRangeQueriesMatchStdSet();
+
+	// Split, join and set operations
+	TestSplitAndJoin();
+	TestSetOperationsMatchStdSet();
+	TestSetOperationsReuseNodes();
+	TestSetOperationsOnTallTrees();
+
+	// Persistent trees
+	TestPersistentVersionsAreIndependent();
+	TestPersistentSnapshotsDuringWrites();
+
+	// Saved trees
+	TestSaveAndMap();
+	TestMappedTreeRejectsBadFiles();
+	TestMappedTreeRejectsBadHeaders();
+
+	// Operation stats
+	TestTreeStatsCounts();
+
+	// Lookup cache
+	TestLookupCacheAnswersRepeatedLookups();
+	TestLookupCacheMatchesStdSet();
+
+	// Transparent lookup
+	TestTransparentLookupBuildsNoTemporaries();
+	TestCustomComparator();
+
+	// Shape diagnostics
+	TestMeasureShape();
+	TestMeasureShapeOfDegenerateTree();
+
+	// Differential stress
+	TestStressPlainTreeMatchesStdSet();
+	TestStressAvlTreeMatchesStdSet();
+	TestStressPoolTreeMatchesStdSet();
+	TestStressSplayTreeMatchesStdSet();
+
+	// Performance gates
+	TestSearchesDontAllocate();
+	TestContainsIsFastEnough();
 
 	TestCase::PrintSummary();
+	return TestCase::FailingCount() == 0 ? 0 : 1;
 }
 
 